@@ -0,0 +1,79 @@
+#include "arena.hpp"
+#include <cstring>
+
+namespace Lithium{
+
+static const size_t block_size = 4096;
+
+Arena::~Arena(){
+    Clear();
+}
+
+void Arena::Clear(){
+    while(first){
+        Block *const next = first->next;
+        heap->Release(first, sizeof(Block)+first->size);
+        first = next;
+    }
+    current = NULL;
+    used = 0;
+}
+
+void Arena::SetHeap(Heap *h){
+    if(h!=heap){
+        Clear();
+        heap = h;
+    }
+}
+
+void *Arena::AllocateSlow(size_t size){
+    /* Move on to the next kept block if it is big enough... */
+    Block *next = current ? current->next : first;
+    if(!next || next->size<size){
+        /* ...otherwise insert a new one after the current block. */
+        const size_t data_size = (size>block_size) ? size : block_size;
+        if(!heap)
+            heap = &GlobalHeap();
+        Block *const block = static_cast<Block *>(heap->Allocate(sizeof(Block)+data_size));
+        block->size = data_size;
+        block->next = next;
+        if(current)
+            current->next = block;
+        else
+            first = block;
+        next = block;
+    }
+    
+    current = next;
+    used = size;
+    return current->Data();
+}
+
+void *Arena::Reallocate(void *at, size_t old_size, size_t new_size){
+    if(new_size<=old_size)
+        return at;
+    
+    /* `at' might not even be from the arena, in which case it is never found
+        at the end of the current block. */
+    const size_t rounded = (old_size+7u) & ~(size_t)7u;
+    if(current && static_cast<char *>(at)+rounded==current->Data()+used){
+        const size_t extra = ((new_size+7u) & ~(size_t)7u) - rounded;
+        if(used+extra<=current->size){
+            used+=extra;
+            return at;
+        }
+    }
+    
+    void *const to = Allocate(new_size);
+    memcpy(to, at, (old_size<new_size) ? old_size : new_size);
+    return to;
+}
+
+char *Arena::CopyString(const char *str, size_t len){
+    char *const to = static_cast<char *>(Allocate(len+1));
+    memcpy(to, str, len);
+    to[len] = '\0';
+    return to;
+}
+
+}
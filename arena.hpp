@@ -0,0 +1,80 @@
+#pragma once
+#include "heap.hpp"
+#include <cstddef>
+
+namespace Lithium{
+
+/* A bump allocator for the temporaries of an execution. Memory is released
+    all at once, either back to a Mark or entirely with Reset, both in constant
+    time. Blocks are kept for reuse, so an arena that has warmed up does not
+    allocate again. */
+class Arena{
+    struct Block{
+        Block *next;
+        size_t size;
+        inline char *Data(){ return reinterpret_cast<char *>(this+1); }
+    };
+    
+    Block *first, *current;
+    size_t used;
+    Heap *heap;
+    
+    void *AllocateSlow(size_t size);
+    void Clear();
+    
+public:
+    
+    struct Mark{
+        Block *block;
+        size_t used;
+    };
+    
+    Arena()
+      : first(NULL), current(NULL), used(0), heap(NULL){}
+    
+    /* Arenas are never shared, so copies start out empty. */
+    Arena(const Arena &)
+      : first(NULL), current(NULL), used(0), heap(NULL){}
+    Arena &operator=(const Arena &){ return *this; }
+    
+    ~Arena();
+    
+    /* Blocks come from the global heap unless a Heap is set. Setting a
+        different Heap releases all blocks, so the arena must not be in use. */
+    void SetHeap(Heap *h);
+    
+    /* Allocations are aligned to eight bytes */
+    inline void *Allocate(size_t size){
+        size = (size+7u) & ~(size_t)7u;
+        if(current && used+size<=current->size){
+            void *const at = current->Data()+used;
+            used+=size;
+            return at;
+        }
+        return AllocateSlow(size);
+    }
+    
+    /* Grows the most recent allocation in place if possible, otherwise copies
+        it to a new allocation. `at' may also be memory from outside the arena. */
+    void *Reallocate(void *at, size_t old_size, size_t new_size);
+    
+    char *CopyString(const char *str, size_t len);
+    
+    inline struct Mark GetMark() const {
+        const struct Mark mark = {current, used};
+        return mark;
+    }
+    
+    inline void Release(const struct Mark &mark){
+        current = mark.block ? mark.block : first;
+        used = mark.used;
+    }
+    
+    inline void Reset(){
+        current = first;
+        used = 0;
+    }
+    
+};
+
+}
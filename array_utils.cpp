@@ -0,0 +1,250 @@
+#include "array_utils.hpp"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+
+#define LITHIUM_SSE2 1
+#include <emmintrin.h>
+
+#endif
+
+namespace Lithium{
+namespace Utils{
+
+/* Whether a kernel has an instruction for pairs of integers. SSE2 can add
+    and subtract them, but not multiply or divide them. */
+struct Pairwise{};
+struct Singly{};
+
+/* Each kernel applies its operation to one element of each operand, or to
+    two at a time with SSE2 */
+struct Add{
+    typedef Pairwise Integers;
+    static inline int64_t Apply(int64_t a, int64_t b){ return static_cast<int64_t>(static_cast<uint64_t>(a)+static_cast<uint64_t>(b)); }
+    static inline double Apply(double a, double b){ return a+b; }
+#ifdef LITHIUM_SSE2
+    static inline __m128i Apply(__m128i a, __m128i b){ return _mm_add_epi64(a, b); }
+    static inline __m128d Apply(__m128d a, __m128d b){ return _mm_add_pd(a, b); }
+#endif
+};
+
+struct Subtract{
+    typedef Pairwise Integers;
+    static inline int64_t Apply(int64_t a, int64_t b){ return static_cast<int64_t>(static_cast<uint64_t>(a)-static_cast<uint64_t>(b)); }
+    static inline double Apply(double a, double b){ return a-b; }
+#ifdef LITHIUM_SSE2
+    static inline __m128i Apply(__m128i a, __m128i b){ return _mm_sub_epi64(a, b); }
+    static inline __m128d Apply(__m128d a, __m128d b){ return _mm_sub_pd(a, b); }
+#endif
+};
+
+struct Multiply{
+    typedef Singly Integers;
+    static inline int64_t Apply(int64_t a, int64_t b){ return static_cast<int64_t>(static_cast<uint64_t>(a)*static_cast<uint64_t>(b)); }
+    static inline double Apply(double a, double b){ return a*b; }
+#ifdef LITHIUM_SSE2
+    static inline __m128d Apply(__m128d a, __m128d b){ return _mm_mul_pd(a, b); }
+#endif
+};
+
+/* The smallest integer divided by -1 wraps around to itself, rather than trapping */
+struct Divide{
+    typedef Singly Integers;
+    static inline int64_t Apply(int64_t a, int64_t b){ return (b==-1) ? static_cast<int64_t>(0-static_cast<uint64_t>(a)) : a/b; }
+    static inline double Apply(double a, double b){ return a/b; }
+#ifdef LITHIUM_SSE2
+    static inline __m128d Apply(__m128d a, __m128d b){ return _mm_div_pd(a, b); }
+#endif
+};
+
+/* Either is taken as it is when they are unordered, as MINPD and MAXPD do */
+struct Minimum{
+    typedef Singly Integers;
+    static inline int64_t Apply(int64_t a, int64_t b){ return a<b ? a : b; }
+    static inline double Apply(double a, double b){ return a<b ? a : b; }
+#ifdef LITHIUM_SSE2
+    static inline __m128d Apply(__m128d a, __m128d b){ return _mm_min_pd(a, b); }
+#endif
+};
+
+struct Maximum{
+    typedef Singly Integers;
+    static inline int64_t Apply(int64_t a, int64_t b){ return a>b ? a : b; }
+    static inline double Apply(double a, double b){ return a>b ? a : b; }
+#ifdef LITHIUM_SSE2
+    static inline __m128d Apply(__m128d a, __m128d b){ return _mm_max_pd(a, b); }
+#endif
+};
+
+/* Kernels of one operand. SSE2 has square roots, and clears sign bits as
+    easily as anything, but has no rounding or trigonometry. */
+struct SquareRoot{
+    typedef Pairwise Floats;
+    static inline double Apply(double a){ return sqrt(a); }
+#ifdef LITHIUM_SSE2
+    static inline __m128d Apply(__m128d a){ return _mm_sqrt_pd(a); }
+#endif
+};
+
+struct Absolute{
+    typedef Pairwise Floats;
+    static inline double Apply(double a){ return fabs(a); }
+#ifdef LITHIUM_SSE2
+    static inline __m128d Apply(__m128d a){ return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+#endif
+};
+
+struct Floor{
+    typedef Singly Floats;
+    static inline double Apply(double a){ return floor(a); }
+};
+
+struct Sine{
+    typedef Singly Floats;
+    static inline double Apply(double a){ return sin(a); }
+};
+
+struct Cosine{
+    typedef Singly Floats;
+    static inline double Apply(double a){ return cos(a); }
+};
+
+/* Applies K to as many pairs of elements as there are, returning how many
+    elements that covered. Loads and stores are unaligned, since host arrays
+    may start anywhere. */
+template<class K, bool Repeat>
+static size_t Pairs(int64_t *to, const int64_t *a, const int64_t *b, size_t n, Pairwise){
+    size_t i = 0;
+#ifdef LITHIUM_SSE2
+    const __m128i repeated = _mm_set1_epi64x(*b);
+    for(; i+2<=n; i+=2){
+        const __m128i y = Repeat ? repeated : _mm_loadu_si128(reinterpret_cast<const __m128i *>(b+i));
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a+i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(to+i), K::Apply(x, y));
+    }
+#else
+    (void)to; (void)a; (void)b; (void)n;
+#endif
+    return i;
+}
+
+template<class K, bool Repeat>
+static size_t Pairs(int64_t *, const int64_t *, const int64_t *, size_t, Singly){
+    return 0;
+}
+
+template<class K, bool Repeat, class Tag>
+static size_t Pairs(double *to, const double *a, const double *b, size_t n, Tag){
+    size_t i = 0;
+#ifdef LITHIUM_SSE2
+    const __m128d repeated = _mm_set1_pd(*b);
+    for(; i+2<=n; i+=2){
+        const __m128d y = Repeat ? repeated : _mm_loadu_pd(b+i);
+        _mm_storeu_pd(to+i, K::Apply(_mm_loadu_pd(a+i), y));
+    }
+#else
+    (void)to; (void)a; (void)b; (void)n;
+#endif
+    return i;
+}
+
+template<class K, bool Repeat, typename T>
+static void Loop(T *to, const T *a, const T *b, size_t n){
+    for(size_t i = Pairs<K, Repeat>(to, a, b, n, typename K::Integers()); i<n; i++)
+        to[i] = K::Apply(a[i], b[Repeat ? 0 : i]);
+}
+
+template<class K, typename T>
+static void Apply(T *to, const T *a, const T *b, bool repeat, size_t n){
+    if(n==0)
+        return;
+    if(repeat)
+        Loop<K, true>(to, a, b, n);
+    else
+        Loop<K, false>(to, a, b, n);
+}
+
+template<class K>
+static size_t Pairs(double *to, const double *a, size_t n, Pairwise){
+    size_t i = 0;
+#ifdef LITHIUM_SSE2
+    for(; i+2<=n; i+=2)
+        _mm_storeu_pd(to+i, K::Apply(_mm_loadu_pd(a+i)));
+#else
+    (void)to; (void)a; (void)n;
+#endif
+    return i;
+}
+
+template<class K>
+static size_t Pairs(double *, const double *, size_t, Singly){
+    return 0;
+}
+
+template<class K>
+static void Apply(double *to, const double *a, size_t n){
+    for(size_t i = Pairs<K>(to, a, n, typename K::Floats()); i<n; i++)
+        to[i] = K::Apply(a[i]);
+}
+
+template<typename T>
+static void Dispatch(Op::Code op, T *to, const T *a, const T *b, bool repeat, size_t n){
+    switch(op){
+        case Op::Add: Apply<Add>(to, a, b, repeat, n); return;
+        case Op::Subtract: Apply<Subtract>(to, a, b, repeat, n); return;
+        case Op::Multiply: Apply<Multiply>(to, a, b, repeat, n); return;
+        case Op::Divide: Apply<Divide>(to, a, b, repeat, n); return;
+        default: return;
+    }
+}
+
+template<typename T>
+static void Dispatch(Intrinsic::Code f, T *to, const T *a, const T *b, bool repeat, size_t n){
+    switch(f){
+        case Intrinsic::Min: Apply<Minimum>(to, a, b, repeat, n); return;
+        case Intrinsic::Max: Apply<Maximum>(to, a, b, repeat, n); return;
+        default: return;
+    }
+}
+
+void Elementwise(Op::Code op, int64_t *to, const int64_t *a, const int64_t *b, bool repeat, size_t n){
+    Dispatch(op, to, a, b, repeat, n);
+}
+
+void Elementwise(Op::Code op, double *to, const double *a, const double *b, bool repeat, size_t n){
+    Dispatch(op, to, a, b, repeat, n);
+}
+
+void Elementwise(Intrinsic::Code f, int64_t *to, const int64_t *a, const int64_t *b, bool repeat, size_t n){
+    Dispatch(f, to, a, b, repeat, n);
+}
+
+void Elementwise(Intrinsic::Code f, double *to, const double *a, const double *b, bool repeat, size_t n){
+    Dispatch(f, to, a, b, repeat, n);
+}
+
+void Elementwise(Intrinsic::Code f, int64_t *to, const int64_t *a, size_t n){
+    if(f==Intrinsic::Abs){
+        /* Negated without overflowing, so the smallest integer stays as it is */
+        for(size_t i = 0; i<n; i++)
+            to[i] = a[i]<0 ? static_cast<int64_t>(0-static_cast<uint64_t>(a[i])) : a[i];
+    }
+    else if(f==Intrinsic::Floor && to!=a){
+        memcpy(to, a, sizeof(int64_t)*n);
+    }
+}
+
+void Elementwise(Intrinsic::Code f, double *to, const double *a, size_t n){
+    switch(f){
+        case Intrinsic::Sqrt: Apply<SquareRoot>(to, a, n); return;
+        case Intrinsic::Sin: Apply<Sine>(to, a, n); return;
+        case Intrinsic::Cos: Apply<Cosine>(to, a, n); return;
+        case Intrinsic::Abs: Apply<Absolute>(to, a, n); return;
+        case Intrinsic::Floor: Apply<Floor>(to, a, n); return;
+        default: return;
+    }
+}
+
+}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "program.hpp"
+#include <cstddef>
+#include <stdint.h>
+
+namespace Lithium{
+namespace Utils{
+
+/* Applies `op', which is Op::Add, Op::Subtract, Op::Multiply, or Op::Divide,
+    to each element of `a' and the element of `b' at the same index, or the
+    only element of `b' if `repeat' is set, into `to'. `to' may be `a' or `b'.
+    Integers wrap around, and the divisors of integers must not be zero. */
+void Elementwise(Op::Code op, int64_t *to, const int64_t *a, const int64_t *b, bool repeat, size_t n);
+void Elementwise(Op::Code op, double *to, const double *a, const double *b, bool repeat, size_t n);
+
+/* The same for Intrinsic::Min and Intrinsic::Max */
+void Elementwise(Intrinsic::Code f, int64_t *to, const int64_t *a, const int64_t *b, bool repeat, size_t n);
+void Elementwise(Intrinsic::Code f, double *to, const double *a, const double *b, bool repeat, size_t n);
+
+/* Applies `f', which is Intrinsic::Sqrt, Sin, Cos, Abs, or Floor, to each
+    element of `a' into `to', which may be `a'. Integers only take Abs and
+    Floor. */
+void Elementwise(Intrinsic::Code f, int64_t *to, const int64_t *a, size_t n);
+void Elementwise(Intrinsic::Code f, double *to, const double *a, size_t n);
+
+}
+}
@@ -0,0 +1,123 @@
+#include "batch.hpp"
+#include "program.hpp"
+#include "compiler.hpp"
+#include "verifier.hpp"
+#include "optimizer.hpp"
+#include "symbol_table.hpp"
+#include "bytecode_utils.hpp"
+
+namespace Lithium{
+
+/* Everything a thread compiles with, all from a Heap of its own */
+struct Batch::Worker{
+    Heap *const heap;
+    SymbolTable symbols;
+    Arena arena;
+
+    explicit Worker(Heap *h)
+      : heap(h)
+      , symbols(Symbols(), h){
+        arena.SetHeap(h);
+    }
+};
+
+Batch::Batch(Context &c, size_t scripts, unsigned count)
+  : context(c){
+    const struct Result none = {NULL, {false, "Script was not compiled"}, 0};
+    results.resize(scripts, none);
+
+    /* Anything first used on every thread is created here */
+    Symbols();
+    const struct Allocator &allocator = context.GetHeap()->GetAllocator();
+    for(unsigned i = 0; i<(count ? count : 1); i++){
+        Heap *const heap = Heap::Create(allocator);
+        workers.push_back(new(heap->Allocate(sizeof(struct Worker))) Worker(heap));
+    }
+}
+
+Batch::~Batch(){
+    for(size_t i = 0; i<results.size(); i++){
+        if(results[i].program)
+            results[i].program->Release();
+    }
+    for(size_t i = 0; i<workers.size(); i++){
+        Heap *const heap = workers[i]->heap;
+        workers[i]->~Worker();
+        heap->Release(workers[i], sizeof(struct Worker));
+        heap->Orphan();
+    }
+}
+
+void Batch::Compile(unsigned worker, size_t index, const char *source, size_t length){
+    struct Worker &w = *workers[worker];
+    struct Result &r = results[index];
+    struct Program *const p = Program::Create(w.heap);
+
+    r.error = Lithium::Compile(source, length, *p, context, w.arena, w.symbols);
+    if(r.error.succeeded)
+        r.error = Verify(*p, context, w.arena, w.symbols);
+    if(r.error.succeeded){
+        Optimize(*p, w.arena);
+        p->context = &context;
+        r.program = p;
+        r.worker = worker;
+    }
+    else{
+        p->Release();
+    }
+}
+
+void Batch::Fail(size_t index, const std::string &error){
+    results[index].error.succeeded = false;
+    results[index].error.error = error;
+}
+
+/* The symbol a worker's name has now that it is interned */
+uint32_t Batch::Remap(const struct Worker &w, uint32_t symbol) const {
+    if(!(symbol&SymbolTable::Scratch))
+        return symbol;
+    return Symbols().Intern(w.symbols.Name(symbol), w.symbols.Length(symbol));
+}
+
+void Batch::Finish(std::vector<struct CompiledScript> &out){
+    out.resize(results.size());
+    for(size_t i = 0; i<results.size(); i++){
+        struct Result &r = results[i];
+        out[i].error = r.error;
+        if(!r.program){
+            out[i].script = Script();
+            continue;
+        }
+
+        /* Names the script introduced are interned in the order they are
+            met here, which only depends on the scripts */
+        const struct Worker &w = *workers[r.worker];
+        struct Program *const p = Program::Create(context.GetHeap());
+        p->Assign(*r.program);
+        r.program->Release();
+        r.program = NULL;
+
+        for(size_t n = 0; n<p->token_procedure_table.size(); n++)
+            p->token_procedure_table[n].symbol = Remap(w, p->token_procedure_table[n].symbol);
+        for(size_t n = 0; n<p->locals.size(); n++)
+            p->locals[n].symbol = Remap(w, p->locals[n].symbol);
+
+        /* Procedures may call those defined later in the script by name */
+        uint8_t *const code = p->token_code.empty() ? NULL : &p->token_code.front();
+        for(uint64_t pc = 0; pc<p->token_code.size();){
+            const Op::Code op = static_cast<Op::Code>(code[pc++]);
+            if(op==Op::CallNamed){
+                uint64_t at = pc;
+                const uint32_t symbol = Utils::GetObject<uint32_t>(code, at);
+                at = pc;
+                Utils::WriteObject<uint32_t>(Remap(w, symbol), code, at);
+            }
+            pc+=Op::OperandBytes(op);
+        }
+
+        out[i].script = Script(p);
+        p->Release();
+    }
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "lithium.hpp"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace Lithium{
+
+/* Compiles many scripts for one Context at once, such as those of a level as
+    it loads, on as many threads as the host gives it. Each thread compiles
+    with its own worker, which interns the names it meets in a table of its
+    own. Finish then gives those names symbols in the order of the scripts,
+    whichever worker compiled them, so the results are the same however the
+    work was split.
+
+    While scripts are being compiled, the Context must not be used, and no
+    names may be added to any Context. The Context's Allocator is called from
+    every thread that compiles. Constant Accessors are not called from other
+    threads, and are read as Stable ones are when the Scripts run instead. */
+class Batch{
+public:
+
+    Batch(Context &context, size_t scripts, unsigned workers);
+    ~Batch();
+
+    inline size_t Size() const { return results.size(); }
+    inline unsigned Workers() const { return workers.size(); }
+
+    /* Compiles script `index' with `worker'. This may be called from any
+        thread, as long as no other thread is using the same worker. */
+    void Compile(unsigned worker, size_t index, const char *source, size_t length);
+
+    /* Gives script `index' an error instead, such as when it can not be read */
+    void Fail(size_t index, const std::string &error);
+
+    /* Puts the Script or the error of each script in `out', in order. This is
+        on the Context's thread, once all of them are compiled. */
+    void Finish(std::vector<struct CompiledScript> &out);
+
+private:
+
+    struct Worker;
+
+    struct Result{
+        /* Allocated from the worker's Heap, until Finish copies it */
+        struct Program *program;
+        struct Error error;
+        unsigned worker;
+    };
+
+    Context &context;
+    std::vector<struct Worker *> workers;
+    std::vector<struct Result> results;
+
+    uint32_t Remap(const struct Worker &w, uint32_t symbol) const;
+
+    Batch(const Batch &);
+    Batch &operator=(const Batch &);
+
+};
+
+}
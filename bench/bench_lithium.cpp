@@ -0,0 +1,297 @@
+/* Microbenchmarks of the interpreter's hot paths. Prints one CSV row per
+    benchmark, with the time, allocations, and bytes allocated per operation.
+    An operation is one execution of the benchmark's script, which is resumed
+    until it finishes if it has an instruction budget. Each benchmark runs a
+    fixed number of iterations, and the median of several samples is kept.
+    
+    Usage: bench_lithium [name filter] */
+#include "lithium.hpp"
+#include "bench_timer.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+namespace Lithium{
+namespace Bench{
+
+static uint64_t allocations = 0, allocated_bytes = 0;
+
+static void *CountingAllocate(void *, size_t size){
+    allocations++;
+    allocated_bytes+=size;
+    return malloc(size);
+}
+
+static void *CountingReallocate(void *, void *at, size_t old_size, size_t new_size){
+    allocations++;
+    if(new_size>old_size)
+        allocated_bytes+=new_size-old_size;
+    return realloc(at, new_size);
+}
+
+static void CountingRelease(void *, void *at, size_t){
+    free(at);
+}
+
+struct Object{
+    int64_t field;
+    float speed;
+    int64_t typed;
+};
+
+static int64_t value = 0;
+static std::string text;
+
+static bool ValueAccessor(void *, struct Value &v, Mode mode){
+    if(mode==Get)
+        IntegerToValue(v, value);
+    else
+        ValueToInteger(v, value);
+    return true;
+}
+
+static bool TextAccessor(void *, struct Value &v, Mode mode){
+    if(mode==Get)
+        StringToValue(v, text);
+    else
+        ValueToString(v, text);
+    return true;
+}
+
+/* Stands for engine state that does not change during an execution */
+static bool ScaleAccessor(void *, struct Value &v, Mode mode){
+    if(mode==Set)
+        return false;
+    IntegerToValue(v, 3);
+    return true;
+}
+
+/* Host memory, read by scripts in place */
+static double samples[256];
+static struct Array samples_array = {Array::Floating, 256, {NULL}};
+
+static bool SamplesAccessor(void *, struct Value &v, Mode mode){
+    if(mode==Set)
+        return false;
+    ArrayToValue(v, samples_array);
+    return true;
+}
+
+static int64_t GetTyped(void *a){
+    return static_cast<struct Object *>(a)->typed;
+}
+
+static void SetTyped(void *a, int64_t in){
+    static_cast<struct Object *>(a)->typed = in;
+}
+
+struct Case{
+    const char *name;
+    std::string script;
+    unsigned iterations;
+    /* Instructions per slice, or 0 to run in one go */
+    uint64_t budget;
+    /* Whether the script is found compiled after the first run, rather than
+        compiled by each run */
+    bool cached;
+};
+
+static std::string Repeat(const char *line, unsigned n){
+    std::string s;
+    for(unsigned i = 0; i<n; i++){
+        s+=line;
+        s+='\n';
+    }
+    return s;
+}
+
+/* A large script of declarations and arithmetic, the same on every run */
+static std::string GenerateScript(unsigned lines){
+    std::string s;
+    char buffer[128];
+    for(unsigned i = 0; i<lines; i++){
+        sprintf(buffer, "int v%u %u * 3 + %u - (2 * %u)\n", i, i, i%7, i%5);
+        s+=buffer;
+        if(i%10==9){
+            sprintf(buffer, "set Value get local v%u + get Value\n", i);
+            s+=buffer;
+        }
+    }
+    return s;
+}
+
+static struct Error Once(Context &ctx, const struct Case &c){
+    if(c.budget==0)
+        return ctx.Execute(c.script);
+    
+    enum Status status;
+    struct Error e = ctx.Execute(c.script, c.budget, status);
+    while(e.succeeded && status==Suspended)
+        e = ctx.Resume(c.budget, status);
+    return e;
+}
+
+static void Run(Context &ctx, const struct Case &c){
+    static const unsigned samples = 5;
+    
+    ctx.SetCacheCapacity(c.cached ? ProgramCache::DefaultCapacity : 0);
+    
+    /* Warm up, which also checks the script */
+    struct Error e = Once(ctx, c);
+    if(!e.succeeded){
+        fprintf(stderr, "%s: %s\n", c.name, e.error.c_str());
+        return;
+    }
+    
+    /* A script that stops working after the first run would otherwise
+        look fast */
+    uint64_t ns[samples], allocs[samples], bytes[samples];
+    for(unsigned s = 0; s<samples; s++){
+        allocations = allocated_bytes = 0;
+        const uint64_t start = Nanoseconds();
+        for(unsigned i = 0; i<c.iterations; i++){
+            if(!(e = Once(ctx, c)).succeeded){
+                fprintf(stderr, "%s: %s\n", c.name, e.error.c_str());
+                return;
+            }
+        }
+        ns[s] = Nanoseconds()-start;
+        allocs[s] = allocations;
+        bytes[s] = allocated_bytes;
+    }
+    
+    /* Allocations do not vary between samples, only the time does */
+    std::sort(ns, ns+samples);
+    const double n = c.iterations;
+    printf("%s,%u,%.1f,%.2f,%.1f\n", c.name, c.iterations,
+        (double)ns[samples/2]/n, (double)allocs[samples/2]/n, (double)bytes[samples/2]/n);
+}
+
+} // namespace Bench
+} // namespace Lithium
+
+int main(int argc, char *argv[]){
+    using namespace Lithium;
+    using namespace Lithium::Bench;
+    
+    const struct Allocator counting = {CountingAllocate, CountingReallocate, CountingRelease, NULL};
+    SetAllocator(counting);
+    
+    struct Object object = {0, 1.0f, 0}, other_object = {0, 0.0f, 0};
+    
+    Context ctx(&object), other(&other_object);
+    ctx.AddAccessor("Value", ValueAccessor);
+    ctx.AddAccessor("Text", TextAccessor);
+    ctx.AddField<int64_t>("Field", offsetof(struct Object, field));
+    ctx.AddField<float>("Speed", offsetof(struct Object, speed));
+    ctx.AddProperty("Typed", GetTyped, SetTyped);
+    ctx.AddAccessor("Scale", ScaleAccessor, Stable);
+    for(unsigned i = 0; i<256; i++)
+        samples[i] = i;
+    samples_array.data.floating = samples;
+    ctx.AddAccessor("Samples", SamplesAccessor);
+    other.AddField<int64_t>("Value", offsetof(struct Object, field));
+    ctx.AddModule("Other", &other);
+    
+    /* The intrinsics of the standard library's Math module */
+    Context math(NULL);
+    math.AddIntrinsic("Sqrt", Intrinsic::Sqrt);
+    math.AddIntrinsic("Clamp", Intrinsic::Clamp);
+    math.AddIntrinsic("Lerp", Intrinsic::Lerp);
+    ctx.AddModule("Math", &math);
+    
+    const struct Case cases[] = {
+        {"arithmetic_int",
+            "set Value 1 + 2 * 3 - 4 / 2 + 5 % 3 * 7 + 10 - 3 * 2 + 8 / 4 + 9 - 1 + 6 * 6 - 12 / 3 + 100 % 7", 100000},
+        {"arithmetic_float",
+            "set Speed 1.5 * 2.25 + 3.75 - 0.5 / 2.0 + 4.125 * 1.5 - 2.5 + 8.0 / 3.0 + 0.75 * 4.0 - 1.25", 100000},
+        /* The fib loop from the README */
+        {"fib_loop",
+            "int fib1 0\n"
+            "int fib2 1\n"
+            "int x 0\n"
+            "loop get local x < 10:\n"
+            "    int temp get local fib2\n"
+            "    set local fib2 get local fib1 + get local fib2\n"
+            "    set local fib1 get local temp\n"
+            "    set local x get local x + 1\n"
+            ".\n", 20000},
+        /* The same, suspended and resumed every 16 instructions */
+        {"fib_loop_sliced",
+            "int fib1 0\n"
+            "int fib2 1\n"
+            "int x 0\n"
+            "loop get local x < 10:\n"
+            "    int temp get local fib2\n"
+            "    set local fib2 get local fib1 + get local fib2\n"
+            "    set local fib1 get local temp\n"
+            "    set local x get local x + 1\n"
+            ".\n", 20000, 16},
+        {"locals_churn",
+            "int a 0\n"
+            "int b 1\n"
+            "int i 0\n"
+            "loop 100 - get local i:\n"
+            "    set local a get local b + get local i\n"
+            "    set local b get local a - 1\n"
+            "    set local i get local i + 1\n"
+            ".\n", 2000},
+        /* Procedures are defined by each run, so these include compiling them */
+        {"procedure_inline",
+            "proc Add a b: return local a + local b .\n" +
+            Repeat("set Field call Add get Field 1", 8), 50000},
+        {"procedure_call",
+            "proc Fib n: if local n - 1: return (call Fib (local n - 1)) + (call Fib (local n - 2)) . return local n .\n"
+            "set Field call Fib 10\n", 5000},
+        {"property_accessor", Repeat("set Value get Value + 1", 8), 50000},
+        {"property_field", Repeat("set Field get Field + 1", 8), 50000},
+        {"property_typed", Repeat("set Typed get Typed + 1", 8), 50000},
+        /* Read through the cache after the first time */
+        {"property_stable",
+            "int i 0\n"
+            "loop 100 - get local i:\n"
+            "    set Field get Field + get Scale\n"
+            "    set local i get local i + 1\n"
+            ".\n", 2000},
+        /* Conditions on properties, where `and' and `or' skip the Accessors
+            on their right when the left decides */
+        {"condition_short_circuit",
+            Repeat("if get Field < 0 and get Value > 0 or get Field >= 0 or get Value = 0: set Field get Field + 1 .", 8), 50000},
+        {"module_from_to", Repeat("to Other Value from Other get Value + 1", 8), 50000},
+        {"string_concat",
+            Repeat("set Text \"The quick \" + \"brown fox \" + 42 + \" jumps over \" + \"the lazy dog \" + get Value", 4), 50000},
+        /* The same work on 256 elements of the host's, whole and one at a time */
+        {"array_bulk",
+            "floats a 0\n"
+            "set local a (get Samples * 0.5 + 1.0) / 2.0\n"
+            "set Field local a at 255\n", 50000},
+        {"array_elements",
+            "floats a 256\n"
+            "int i 0\n"
+            "loop local i < 256:\n"
+            "    set local a at local i (get Samples at local i * 0.5 + 1.0) / 2.0\n"
+            "    set local i local i + 1\n"
+            ".\n"
+            "set Field local a at 255\n", 1000},
+        {"math_intrinsic",
+            Repeat("set Speed from Math call Clamp (from Math call Sqrt get Speed + 1.0) 0.0 100.0", 8), 50000},
+        {"math_intrinsic_array",
+            "floats a 0\n"
+            "set local a from Math call Lerp (from Math call Sqrt get Samples) 8.0 0.25\n"
+            "set Field local a at 255\n", 50000},
+        {"parse_large", GenerateScript(2000), 50},
+        {"cached_property_field", Repeat("set Field get Field + 1", 8), 50000, 0, true},
+        {"cached_large", GenerateScript(2000), 50, 0, true},
+        {"cached_math_intrinsic",
+            Repeat("set Speed from Math call Clamp (from Math call Sqrt get Speed + 1.0) 0.0 100.0", 8), 50000, 0, true}
+    };
+    
+    puts("benchmark,iterations,ns_per_op,allocations_per_op,bytes_per_op");
+    for(unsigned i = 0; i<sizeof(cases)/sizeof(cases[0]); i++){
+        if(argc>1 && strstr(cases[i].name, argv[1])==NULL)
+            continue;
+        Run(ctx, cases[i]);
+    }
+    
+    return EXIT_SUCCESS;
+}
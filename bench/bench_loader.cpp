@@ -0,0 +1,81 @@
+/* Times compiling a pack of generated scripts with CompileScripts on one
+    thread, and on more up to one for each processor. */
+#include "lithium.hpp"
+#include "lithium_loader.hpp"
+#include "bench_timer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace Lithium{
+namespace Bench{
+
+static int64_t value = 0;
+
+static bool ValueAccessor(void *, struct Value &v, Mode mode){
+    if(mode==Get)
+        IntegerToValue(v, value);
+    else
+        ValueToInteger(v, value);
+    return true;
+}
+
+/* Each script declares its own variables and procedures, as the scripts of
+    different objects would */
+static ::std::string GenerateScript(unsigned n, unsigned lines){
+    ::std::string s;
+    char buffer[160];
+    sprintf(buffer, "proc Step%u a:\n    return get local a * 3 + %u\n.\n", n, n%11);
+    s+=buffer;
+    for(unsigned i = 0; i<lines; i++){
+        sprintf(buffer, "int s%ux%u %u * 3 + %u - (2 * %u)\n", n, i, i, i%7, i%5);
+        s+=buffer;
+        if(i%10==9){
+            sprintf(buffer, "if get local s%ux%u > 10 and get Value < 100: set Value call Step%u get local s%ux%u .\n",
+                n, i, n, n, i);
+            s+=buffer;
+        }
+    }
+    return s;
+}
+
+} // namespace Bench
+} // namespace Lithium
+
+int main(){
+    using namespace Lithium;
+    using namespace Lithium::Bench;
+    
+    static const unsigned scripts = 2000, lines = 100, samples = 5;
+    
+    ::std::vector< ::std::string> pack;
+    for(unsigned i = 0; i<scripts; i++)
+        pack.push_back(GenerateScript(i, lines));
+    
+    Context ctx(NULL);
+    ctx.AddAccessor("Value", ValueAccessor);
+    
+    printf("threads,scripts,milliseconds,speedup\n");
+    const unsigned processors = lithium_processor_count();
+    double single = 0.0;
+    for(unsigned threads = 1; threads<=processors; threads = (threads*2<=processors || threads==processors) ? threads*2 : processors){
+        uint64_t ns[samples];
+        for(unsigned s = 0; s<samples; s++){
+            ::std::vector<struct CompiledScript> out;
+            const uint64_t start = Nanoseconds();
+            Lithium::std::CompileScripts(&ctx, pack, out, threads);
+            ns[s] = Nanoseconds()-start;
+            if(!out[0].error.succeeded){
+                fprintf(stderr, "%s\n", out[0].error.error.c_str());
+                return 1;
+            }
+        }
+        ::std::sort(ns, ns+samples);
+        const double ms = (double)ns[samples/2]/1000000.0;
+        if(threads==1)
+            single = ms;
+        printf("%u,%u,%.2f,%.2f\n", threads, scripts, ms, single/ms);
+    }
+    return 0;
+}
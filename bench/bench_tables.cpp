@@ -0,0 +1,147 @@
+/* Compares the std::map tables Contexts used to hold with the symbol keyed
+    FlatTables they hold now, at 10, 100, and 1000 entries. */
+#include "lithium.hpp"
+#include "bench_timer.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <map>
+
+namespace Lithium{
+namespace Bench{
+
+static uint64_t map_bytes = 0;
+
+/* Counts the bytes that std::map asks for */
+template<typename T>
+struct CountingAllocator{
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template<typename U> struct rebind{ typedef CountingAllocator<U> other; };
+    
+    CountingAllocator(){}
+    template<typename U> CountingAllocator(const CountingAllocator<U> &){}
+    
+    pointer address(reference r) const { return &r; }
+    const_pointer address(const_reference r) const { return &r; }
+    
+    pointer allocate(size_type n, const void * = 0){
+        map_bytes += n*sizeof(T);
+        return static_cast<pointer>(malloc(n*sizeof(T)));
+    }
+    void deallocate(pointer p, size_type n){
+        map_bytes -= n*sizeof(T);
+        free(p);
+    }
+    size_type max_size() const { return std::numeric_limits<size_type>::max()/sizeof(T); }
+    void construct(pointer p, const T &t){ new(static_cast<void *>(p)) T(t); }
+    void destroy(pointer p){ p->~T(); }
+};
+
+template<typename T, typename U>
+bool operator==(const CountingAllocator<T> &, const CountingAllocator<U> &){ return true; }
+template<typename T, typename U>
+bool operator!=(const CountingAllocator<T> &, const CountingAllocator<U> &){ return false; }
+
+typedef std::map<std::string, struct Binding, std::less<std::string>,
+    CountingAllocator<std::pair<const std::string, struct Binding> > > MapTable;
+typedef Utils::FlatTable<struct Binding> FlatTable;
+
+static struct Binding MakeBinding(size_t i){
+    struct Binding b;
+    b.kind = Binding::Field;
+    b.type = Value::Integer;
+    b.bind.offset = i;
+    return b;
+}
+
+static void Run(unsigned entries){
+    std::vector<std::string> names(entries);
+    for(unsigned i = 0; i<entries; i++){
+        char buffer[32];
+        sprintf(buffer, "Property%u", i);
+        names[i] = buffer;
+    }
+    
+    const unsigned rounds = 200000/entries;
+    const unsigned lookups = 2000000;
+    volatile size_t sink = 0;
+    
+    /* std::map keyed by std::string */
+    {
+        uint64_t start = Nanoseconds();
+        for(unsigned r = 0; r<rounds; r++){
+            MapTable table;
+            for(unsigned i = 0; i<entries; i++)
+                table[names[i]] = MakeBinding(i);
+            sink += table.size();
+        }
+        const double insert_ns = (double)(Nanoseconds()-start)/((double)rounds*entries);
+        
+        MapTable table;
+        map_bytes = 0;
+        for(unsigned i = 0; i<entries; i++)
+            table[names[i]] = MakeBinding(i);
+        /* Include the heap buffers of the keys, which short strings may not use */
+        uint64_t bytes = map_bytes;
+        for(unsigned i = 0; i<entries; i++)
+            if(names[i].capacity() >= sizeof(std::string))
+                bytes += names[i].capacity()+1;
+        
+        start = Nanoseconds();
+        for(unsigned i = 0; i<lookups; i++)
+            sink += table.find(names[i%entries])->second.bind.offset;
+        const double lookup_ns = (double)(Nanoseconds()-start)/lookups;
+        
+        printf("std_map,%u,%.2f,%.2f,,%lu\n", entries, insert_ns, lookup_ns, (unsigned long)bytes);
+    }
+    
+    /* FlatTable keyed by symbol */
+    {
+        std::vector<uint32_t> symbols(entries);
+        for(unsigned i = 0; i<entries; i++)
+            symbols[i] = Symbols().Intern(names[i]);
+        
+        uint64_t start = Nanoseconds();
+        for(unsigned r = 0; r<rounds; r++){
+            FlatTable table;
+            for(unsigned i = 0; i<entries; i++)
+                table[Symbols().Intern(names[i])] = MakeBinding(i);
+            sink += table.Size();
+        }
+        const double insert_ns = (double)(Nanoseconds()-start)/((double)rounds*entries);
+        
+        FlatTable table;
+        for(unsigned i = 0; i<entries; i++)
+            table[symbols[i]] = MakeBinding(i);
+        
+        start = Nanoseconds();
+        for(unsigned i = 0; i<lookups; i++)
+            sink += table.Find(Symbols().Find(names[i%entries]))->bind.offset;
+        const double name_lookup_ns = (double)(Nanoseconds()-start)/lookups;
+        
+        start = Nanoseconds();
+        for(unsigned i = 0; i<lookups; i++)
+            sink += table.Find(symbols[i%entries])->bind.offset;
+        const double symbol_lookup_ns = (double)(Nanoseconds()-start)/lookups;
+        
+        printf("flat_table,%u,%.2f,%.2f,%.2f,%lu\n", entries, insert_ns, name_lookup_ns, symbol_lookup_ns,
+            (unsigned long)table.Bytes());
+    }
+}
+
+} // namespace Bench
+} // namespace Lithium
+
+int main(){
+    puts("storage,entries,insert_ns,lookup_by_name_ns,lookup_by_symbol_ns,bytes");
+    Lithium::Bench::Run(10);
+    Lithium::Bench::Run(100);
+    Lithium::Bench::Run(1000);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace Lithium{
+namespace Bench{
+
+/* Monotonic nanoseconds, for timing benchmark loops */
+inline uint64_t Nanoseconds(){
+#ifdef _WIN32
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)now.QuadPart * 1000000000.0 / (double)frequency.QuadPart);
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((uint64_t)t.tv_sec*1000000000u) + t.tv_nsec;
+#endif
+}
+
+} // namespace Bench
+} // namespace Lithium
@@ -1,23 +1,18 @@
 #pragma once
 #include <stdint.h>
+#include <cstring>
 
 namespace Lithium{
 namespace Utils{
 
-template<int N>
-void GetArray(uint8_t *i, const uint8_t *bytecode, uint64_t &offset){
-    i[0] = bytecode[offset++];
-    GetArray<N-1>(i+1, bytecode, offset);
-}
-
-template<>
-void GetArray<0>(uint8_t *, const uint8_t *, uint64_t &){}
-
+/* Operands are unaligned. A fixed size memcpy is a single load, where
+    copying bytes one at a time is not once T is as large as a double. */
 template<typename T>
-T GetObject(const uint8_t *bytecode, uint64_t &offset){
-    union{T t; uint8_t c[sizeof(T)]; } val;
-    GetArray<sizeof(T)>(val.c, bytecode, offset);
-    return val.t;
+inline T GetObject(const uint8_t *bytecode, uint64_t &offset){
+    T t;
+    memcpy(&t, bytecode+offset, sizeof(T));
+    offset+=sizeof(T);
+    return t;
 }
 
 template<int N>
@@ -27,7 +22,7 @@ void WriteArray(const uint8_t *i, uint8_t *bytecode, uint64_t &offset){
 }
 
 template<>
-void WriteArray<0>(const uint8_t *, uint8_t *, uint64_t &){}
+inline void WriteArray<0>(const uint8_t *, uint8_t *, uint64_t &){}
  
 template<typename T>
 void WriteObject(const T &t, uint8_t *bytecode, uint64_t &offset){
@@ -59,9 +54,9 @@ struct name_finder{
 
 template<typename T, typename C>
 void AppendObject(const T &obj, C &append_to){
-    uint64_t at = append_to.size();
-    append_to.resize(at+4);
-    Utils::WriteObject<T>(obj, &(append_to.front()), at);
+    union{T t; uint8_t c[sizeof(T)]; } val;
+    val.t = obj;
+    append_to.insert(append_to.end(), val.c, val.c+sizeof(T));
 }
 
 } // namespace Utils
@@ -0,0 +1,1336 @@
+#include "compiler.hpp"
+#include "bytecode_utils.hpp"
+#include "strtoll.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace Lithium{
+
+/* The most bytes of code a procedure may take to be inlined */
+static const uint32_t MaxInlineSize = 64;
+
+/* The fewest bytes of source a procedure's body may have to be deferred */
+static const uint32_t MinDeferredSize = 256;
+
+class Compiler {
+    struct Program &program;
+    const Context &context;
+    Arena &arena;
+    SymbolTable &symbols;
+    const char *const source, *const end;
+
+    /* Whether Constant Accessors may be read, which is only on the
+        Context's own thread */
+    const bool constants;
+
+    /* Whether long procedures are deferred until they are called */
+    const bool lazy;
+
+    /* Where each line of the source starts, for the line table */
+    const uint32_t *line_starts;
+    uint32_t line_count, located;
+
+    /* The start of the innermost statement being compiled */
+    const char *statement;
+
+    /* Variables declared in all open scopes, most recent first, with the
+        variable each hides. The list lives in the arena. */
+    struct Declaration{
+        uint32_t symbol;
+        /* One more than the index in locals of the hidden variable, or 0 */
+        uint32_t shadowed;
+        struct Declaration *next;
+    };
+    struct Declaration *declared;
+
+    /* Procedures defined so far. The source of a procedure that can be
+        inlined is compiled again at each call. */
+    struct Definition{
+        uint32_t symbol, index, arguments;
+        const uint32_t *parameters;
+        const char *body;
+        bool inlinable;
+        struct Definition *next;
+    };
+    struct Definition *definitions;
+
+    /* The procedure being compiled, if any, and whether its body has
+        returned at its top level */
+    struct Definition *defining;
+    bool returned;
+
+    /* The depth of procedures being inlined, and whether the innermost has
+        left its result on the stack */
+    unsigned inlining;
+    bool inline_returned;
+
+    /* Slots in use by the open scopes and the depth of the stack, and the
+        most of each the current frame needs */
+    uint32_t slots, depth, frame_slots, frame_stack;
+
+    /* The first of locals that belongs to the current frame */
+    uint32_t first_local;
+
+    /* How many scopes are open in the current frame */
+    unsigned nesting;
+
+    /* The last instruction emitted */
+    Op::Code last;
+
+    /* Whether the current statement may leave temporaries in the arena */
+    bool temporaries;
+
+public:
+
+    Compiler(struct Program &p, const Context &c, Arena &a, SymbolTable &t, bool k, bool l, const char *s, const char *e)
+      : program(p)
+      , context(c)
+      , arena(a)
+      , symbols(t)
+      , source(s)
+      , end(e)
+      , constants(k)
+      , lazy(l)
+      , line_starts(NULL)
+      , line_count(0)
+      , located(1)
+      , statement(s)
+      , declared(NULL)
+      , definitions(NULL)
+      , defining(NULL)
+      , returned(false)
+      , inlining(0)
+      , inline_returned(false)
+      , slots(0)
+      , depth(0)
+      , frame_slots(0)
+      , frame_stack(0)
+      , first_local(0)
+      , nesting(0)
+      , last(Op::End)
+      , temporaries(false){
+        err.succeeded = true;
+
+        line_count = 1+static_cast<uint32_t>(std::count(source, end, '\n'));
+        uint32_t *const starts = static_cast<uint32_t *>(arena.Allocate(sizeof(uint32_t)*line_count));
+        starts[0] = 0;
+        for(uint32_t n = 0, l = 1; l<line_count; n++){
+            if(source[n]=='\n')
+                starts[l++] = n+1;
+        }
+        line_starts = starts;
+    }
+
+    struct Error err;
+
+    void Fail(const std::string &error){
+        err.succeeded = false;
+        err.error = error;
+    }
+
+    static bool IsWhitespace(char c){
+        return c==' ' || c=='\t' || c=='\n' || c=='\r';
+    }
+
+    static bool IsSyntax(char c){
+        return (c>=35 && c<=47 && c!=46) || (c>=91 && c<=96) || (c>=123 && c<=126) || (c>=58 && c<=64);
+    }
+
+    void SkipWhitespace(const char *&i) const {
+        while(i!=end && IsWhitespace(*i)) i++;
+    }
+
+    /* An identifier, which refers to the source rather than copying it */
+    struct Token{
+        const char *start, *end;
+
+        inline size_t Size() const { return end-start; }
+        inline char First() const { return (start!=end) ? *start : '\0'; }
+
+        template<size_t N>
+        inline bool Is(const char (&word)[N]) const {
+            return Size()==N-1 && std::equal(start, end, word);
+        }
+
+        /* Only for error messages */
+        inline std::string String() const { return std::string(start, end); }
+    };
+
+    inline uint32_t Find(const Token &t) const { return (t.start!=t.end) ? symbols.Find(t.start, t.Size()) : 0; }
+    inline uint32_t Intern(const Token &t){ return (t.start!=t.end) ? symbols.Intern(t.start, t.Size()) : 0; }
+
+    Token GetIdentifier(const char *&i) const {
+        SkipWhitespace(i);
+        Token token;
+        token.start = i;
+        while(i!=end && !IsWhitespace(*i) && !IsSyntax(*i)) i++;
+        token.end = i;
+        return token;
+    }
+
+    inline uint32_t Here() const { return program.token_code.size(); }
+
+    /* `pushes' is how many Values the instruction leaves on the stack, less
+        those it takes from it. */
+    void Emit(Op::Code op, int pushes){
+        program.token_code.push_back(op);
+        last = op;
+        depth+=pushes;
+        if(depth>frame_stack)
+            frame_stack = depth;
+    }
+
+    template<typename T>
+    void Emit(Op::Code op, int pushes, const T &operand){
+        Emit(op, pushes);
+        Utils::AppendObject<T>(operand, program.token_code);
+    }
+
+    template<typename T, typename U>
+    void Emit(Op::Code op, int pushes, const T &first, const U &second){
+        Emit<T>(op, pushes, first);
+        Utils::AppendObject<U>(second, program.token_code);
+    }
+
+    template<typename T, typename U, typename V>
+    void Emit(Op::Code op, int pushes, const T &first, const U &second, const V &third){
+        Emit<T, U>(op, pushes, first, second);
+        Utils::AppendObject<V>(third, program.token_code);
+    }
+
+    /* Records that the code from here on is that of the statement at `at' */
+    void Locate(const char *at){
+        const uint32_t offset = at-source;
+        /* Statements mostly follow the last, other than inlined bodies */
+        uint32_t line = located;
+        if(offset<line_starts[line-1])
+            line = std::upper_bound(line_starts, line_starts+line_count, offset)-line_starts;
+        else
+            while(line<line_count && line_starts[line]<=offset) line++;
+        located = line;
+        const struct Program::Line l = {Here(), line, offset-line_starts[line-1]+1};
+        if(!program.lines.empty() && program.lines.back().pc==l.pc)
+            program.lines.back() = l;
+        else
+            program.lines.push_back(l);
+    }
+
+    /* Emits a jump, returning where its target is to be patched */
+    uint32_t EmitJump(Op::Code op, int pushes){
+        Emit<uint32_t>(op, pushes, 0);
+        return Here()-sizeof(uint32_t);
+    }
+
+    /* Records where a jump goes, for the verifier */
+    void Target(uint32_t to, bool backwards){
+        program.targets.push_back(to);
+        program.backwards = program.backwards || backwards;
+    }
+
+    void Patch(uint32_t at, uint32_t to){
+        Target(to, false);
+        uint64_t offset = at;
+        Utils::WriteObject<uint32_t>(to, &program.token_code.front(), offset);
+    }
+
+    /* Releases anything the statement so far has put in the arena. Returns
+        whether there was anything to release. The statements of an inlined
+        procedure leave that to the statement that called it. */
+    bool ReleaseTemporaries(){
+        if(!temporaries || inlining)
+            return false;
+        Emit(Op::Release, 0);
+        temporaries = false;
+        return true;
+    }
+
+    void EmitString(const char *str, size_t len){
+        const uint32_t offset = program.string_table.size();
+        program.string_table.insert(program.string_table.end(), str, str+len);
+        program.string_table.push_back('\0');
+        Emit<uint32_t>(Op::String, 1, offset);
+    }
+
+    /* The Binding of a property as it is now, and the Context it is of */
+    const struct Binding *FindBinding(uint32_t module, uint32_t symbol, const Context *&owner) const {
+        owner = module ? context.GetModule(module) : &context;
+        return owner ? owner->properties->Find(symbol) : NULL;
+    }
+
+    /* Where a Stable property is in the cache, adding it if it is new */
+    uint32_t Cache(uint32_t module, uint32_t symbol){
+        for(uint32_t n = 0; n<program.cached.size(); n++){
+            if(program.cached[n].module==module && program.cached[n].symbol==symbol)
+                return n;
+        }
+        const struct Program::Cached cached = {module, symbol};
+        program.cached.push_back(cached);
+        return program.cached.size()-1;
+    }
+
+    /* Reads a property, of a module unless `module' is 0. A Constant Accessor
+        is read now instead, and a Stable one is read through the cache, as
+        is a Constant one when it can not be read yet. */
+    void GetProperty(uint32_t module, uint32_t symbol){
+        const Context *owner;
+        const struct Binding *const b = FindBinding(module, symbol, owner);
+        if(constants && b && b->kind==Binding::Callback && b->purity==Constant){
+            struct Value v;
+            v.type = Value::Null;
+            if(b->bind.accessor(owner->object, v, Get)){
+                switch(v.type){
+                    case Value::Integer:
+                        Emit<int64_t>(Op::Integer, 1, v.value.integer);
+                        return;
+                    case Value::Floating:
+                        Emit<double>(Op::Floating, 1, v.value.floating);
+                        return;
+                    case Value::Boolean:
+                        Emit<uint8_t>(Op::Boolean, 1, v.value.boolean);
+                        return;
+                    case Value::String:
+                        {
+                            const size_t len = strlen(v.value.string);
+                            EmitString(v.value.string, len);
+                            GlobalHeap().Release(v.value.string, len+1);
+                        }
+                        return;
+                    case Value::Null:
+                    case Value::Array:
+                        break;
+                }
+            }
+        }
+
+        temporaries = true;
+        if(b && b->kind==Binding::Callback && b->purity!=Volatile)
+            Emit<uint32_t>(Op::GetCached, 1, Cache(module, symbol));
+        else if(module)
+            Emit<uint32_t, uint32_t>(Op::GetModuleProperty, 1, module, symbol);
+        else
+            Emit<uint32_t>(Op::GetProperty, 1, symbol);
+    }
+
+    void SetProperty(uint32_t module, uint32_t symbol){
+        const Context *owner;
+        const struct Binding *const b = FindBinding(module, symbol, owner);
+        if(b && b->kind==Binding::Callback && b->purity==Stable)
+            Emit<uint32_t>(Op::SetCached, -1, Cache(module, symbol));
+        else if(module)
+            Emit<uint32_t, uint32_t>(Op::SetModuleProperty, -1, module, symbol);
+        else
+            Emit<uint32_t>(Op::SetProperty, -1, symbol);
+    }
+
+    /* Only variables of the current frame are visible */
+    struct Program::Local *FindVariable(uint32_t symbol){
+        const uint32_t *const local = program.in_scope.Find(symbol);
+        return (local && *local>=first_local) ? &program.locals[*local] : NULL;
+    }
+
+    bool LoadVariable(const Token &name){
+        const struct Program::Local *const local = FindVariable(Find(name));
+        if(!local){
+            Fail(std::string("Undefined Variable \"") + name.String() + '"');
+            return false;
+        }
+        Emit<uint32_t>(Op::Load, 1, local->slot);
+        return true;
+    }
+
+    /* Brings a variable into scope in the next slot, returning the slot */
+    uint32_t Declare(uint32_t symbol){
+        const uint32_t slot = slots++;
+        if(slots>frame_slots)
+            frame_slots = slots;
+
+        struct Declaration *const d =
+            static_cast<struct Declaration *>(arena.Allocate(sizeof(struct Declaration)));
+        const uint32_t *const hidden = program.in_scope.Find(symbol);
+        d->symbol = symbol;
+        d->shadowed = hidden ? *hidden+1 : 0;
+        d->next = declared;
+        declared = d;
+
+        const struct Program::Local local = {symbol, slot, Here(), Here(), defining ? defining->index+1 : 0};
+        program.in_scope[symbol] = program.locals.size();
+        program.locals.push_back(local);
+        return slot;
+    }
+
+    /* Destroys all variables declared since `outer' */
+    void CloseScope(const struct Declaration *outer, uint32_t outer_slots){
+        while(declared!=outer){
+            program.locals[*program.in_scope.Find(declared->symbol)].end = Here();
+            if(declared->shadowed)
+                program.in_scope[declared->symbol] = declared->shadowed-1;
+            else
+                program.in_scope.Erase(declared->symbol);
+            declared = declared->next;
+        }
+        if(slots!=outer_slots)
+            Emit<uint32_t, uint32_t>(Op::Clear, 0, outer_slots, slots-outer_slots);
+        slots = outer_slots;
+    }
+
+    struct Definition *FindDefinition(uint32_t symbol) const {
+        for(struct Definition *d = definitions; d; d = d->next){
+            if(d->symbol==symbol)
+                return d;
+        }
+        return NULL;
+    }
+
+    /* A procedure that calls, loops, or suspends is not inlined */
+    void NotInlinable(){
+        if(defining && !inlining)
+            defining->inlinable = false;
+    }
+
+    /* Whether an expression follows. Calls that take as many arguments as
+        are given do not take calls or module accesses without parentheses,
+        since those are also statements. */
+    bool StartsFactor(const char *i, bool calls = true) const {
+        SkipWhitespace(i);
+        if(i==end)
+            return false;
+        if((*i)=='"' || (*i)=='(' || IsDecDigit(*i))
+            return true;
+        const Token word = GetIdentifier(i);
+        return word.Is("get") || word.Is("local") || word.Is("true") || word.Is("false") || word.Is("not") ||
+            word.Is("length") || (calls && (word.Is("from") || word.Is("call")));
+    }
+
+    uint32_t Arguments(const char *&i){
+        uint32_t arguments = 0;
+        while(err.succeeded && StartsFactor(i, false)){
+            Expression(i);
+            arguments++;
+        }
+        return arguments;
+    }
+
+    /* Compiles the body of `d' in place of a call, with its arguments on the
+        stack. The result is left on the stack as a call's would be. */
+    void Inline(const struct Definition &d){
+        const struct Declaration *const outer = declared;
+        const uint32_t outer_slots = slots, outer_first_local = first_local;
+        const bool outer_returned = inline_returned;
+
+        /* The variables of the caller are not visible to the body */
+        first_local = program.locals.size();
+
+        for(uint32_t n = d.arguments; n>0; n--)
+            Emit<uint32_t>(Op::Store, -1, slots+n-1);
+        for(uint32_t n = 0; n<d.arguments; n++)
+            Declare(d.parameters[n]);
+
+        inlining++;
+        inline_returned = false;
+
+        const char *i = d.body;
+        Scope(i);
+        if(err.succeeded && !inline_returned)
+            Emit(Op::Null, 1);
+
+        inlining--;
+        inline_returned = outer_returned;
+        Locate(statement);
+
+        if(err.succeeded)
+            CloseScope(outer, outer_slots);
+        first_local = outer_first_local;
+    }
+
+    void Call(const char *&i){
+        const Token name = GetIdentifier(i);
+        SkipWhitespace(i);
+
+        if(name.Size()==0){
+            Fail("Expected a procedure name after call");
+            return;
+        }
+
+        NotInlinable();
+        temporaries = true;
+
+        const uint32_t symbol = Intern(name);
+        const struct Definition *const d = FindDefinition(symbol);
+        if(!d){
+            /* Not defined yet, so it is found by name when called */
+            const uint32_t arguments = Arguments(i);
+            if(err.succeeded)
+                Emit<uint32_t, uint32_t>(Op::CallNamed, 1-(int)arguments, symbol, arguments);
+            return;
+        }
+
+        for(uint32_t n = 0; n<d->arguments; n++){
+            if(!StartsFactor(i)){
+                char count[16];
+                sprintf(count, "%u", d->arguments);
+                Fail(std::string("Procedure ") + name.String() + " takes " + count + " arguments");
+                return;
+            }
+            Expression(i);
+            if(!err.succeeded)
+                return;
+        }
+
+        if(d->inlinable)
+            Inline(*d);
+        else
+            Emit<uint32_t>(Op::Call, 1-(int)d->arguments, d->index);
+    }
+
+    /* Intrinsics take as many arguments as they always do */
+    void CallIntrinsic(const char *&i, const Token &name, Intrinsic::Code f){
+        const unsigned arguments = Intrinsic::Arguments(f);
+        for(unsigned n = 0; n<arguments; n++){
+            if(!StartsFactor(i)){
+                char count[16];
+                sprintf(count, "%u", arguments);
+                Fail(std::string("Procedure ") + name.String() + " takes " + count + " arguments");
+                return;
+            }
+            Expression(i);
+            if(!err.succeeded)
+                return;
+        }
+        Emit<uint8_t>(Op::Intrinsic, 1-(int)arguments, f);
+    }
+
+    static bool NotIsDecDigit(char c){
+        return !IsDecDigit(c);
+    }
+
+    /* A factor without any `at' after it */
+    void Primary(const char *&i){
+
+        SkipWhitespace(i);
+
+        if(i!=end && (*i)=='"'){
+            const char *const start = ++i;
+            while(i!=end && (*i)!='"') i++;
+            if(i==end){
+                Fail("Unexpected end of input in string literal");
+                return;
+            }
+
+            EmitString(start, i-start);
+            i++;
+            SkipWhitespace(i);
+            return;
+        }
+        else if(i!=end && (*i)=='('){
+            i++;
+            Expression(i);
+            if(!err.succeeded)
+                return;
+
+            SkipWhitespace(i);
+
+            if(i==end || (*i)!=')'){
+                Fail("Expected ')'");
+                return;
+            }
+
+            i++;
+            SkipWhitespace(i);
+            return;
+        }
+
+        Token value = GetIdentifier(i);
+
+        /* If all of value is decimal digits and *i is a '.', then the literal continues past it */
+        if(i!=end && (i+1)!=end && (*i)=='.' && std::find_if(value.start, value.end, NotIsDecDigit)==value.end && !IsWhitespace(*(i+1))){
+            i++;
+            value.end = GetIdentifier(i).end;
+        }
+
+        SkipWhitespace(i);
+
+        if(IsDecDigit(value.First())){
+            /* Literals are short, so they are terminated on the stack */
+            char literal[64];
+            if(value.Size()>=sizeof(literal)){
+                Fail(std::string("Numeric literal is too long \"") + value.String() + '"');
+                return;
+            }
+            std::copy(value.start, value.end, literal);
+            literal[value.Size()] = '\0';
+
+            if(std::find(value.start, value.end, '.')!=value.end){
+                double f;
+                if(StrToDouble(literal, &f)!=1)
+                    Fail(std::string("Invlalid floating point literal \"") + value.String() + '"');
+                else
+                    Emit<double>(Op::Floating, 1, f);
+            }
+            else{
+                int64_t n;
+                if(StrToInt64(literal, &n)!=1)
+                    Fail(std::string("Invlalid integer literal \"") + value.String() + '"');
+                else
+                    Emit<int64_t>(Op::Integer, 1, n);
+            }
+        }
+        else if(value.Is("true")){
+            Emit<uint8_t>(Op::Boolean, 1, 1);
+        }
+        else if(value.Is("false")){
+            Emit<uint8_t>(Op::Boolean, 1, 0);
+        }
+        else if(value.Is("get")){
+            const Token ident = GetIdentifier(i);
+            SkipWhitespace(i);
+
+            if(ident.Is("local")){
+                const Token variable_name = GetIdentifier(i);
+                SkipWhitespace(i);
+                LoadVariable(variable_name);
+            }
+            else{
+                GetProperty(0, Intern(ident));
+            }
+        }
+        else if(value.Is("from")){
+            const Token module_name = GetIdentifier(i);
+            SkipWhitespace(i);
+
+            Token ident = GetIdentifier(i);
+            SkipWhitespace(i);
+
+            if(ident.Is("get")){
+                ident = GetIdentifier(i);
+                SkipWhitespace(i);
+            }
+            else if(ident.Is("call")){
+                const Token name = GetIdentifier(i);
+                SkipWhitespace(i);
+                temporaries = true;
+
+                const Context *const module = context.GetModule(Intern(module_name));
+                const uint8_t *const intrinsic = module ? module->intrinsics->Find(Intern(name)) : NULL;
+                if(intrinsic){
+                    CallIntrinsic(i, name, static_cast<Intrinsic::Code>(*intrinsic));
+                    return;
+                }
+
+                NotInlinable();
+
+                const uint32_t arguments = Arguments(i);
+                if(err.succeeded)
+                    Emit<uint32_t, uint32_t, uint32_t>(Op::CallModule, 1-(int)arguments,
+                        Intern(module_name), Intern(name), arguments);
+                return;
+            }
+
+            if(ident.Is("local")){
+                Fail("Cannot get value \"local\" of remote object");
+            }
+            else{
+                GetProperty(Intern(module_name), Intern(ident));
+            }
+        }
+        else if(value.Is("local")){
+            const Token ident = GetIdentifier(i);
+            SkipWhitespace(i);
+            LoadVariable(ident);
+        }
+        else if(value.Is("call")){
+            Call(i);
+        }
+        else if(value.Is("length")){
+            Primary(i);
+            if(err.succeeded)
+                Emit(Op::Length, 0);
+        }
+        else{
+            Fail(std::string("Expected literal, sub-expression, or access at \"") + value.String() + '"');
+        }
+    }
+
+    /* `<primary> [at <primary>]...' indexes arrays */
+    void Factor(const char *&i){
+        Primary(i);
+        while(err.succeeded && Keyword(i, "at")){
+            Primary(i);
+            if(err.succeeded)
+                Emit(Op::Index, -1);
+        }
+    }
+
+    void Term(const char *&i){
+        Factor(i);
+        SkipWhitespace(i);
+
+        while(err.succeeded && i!=end && ((*i)=='*' || (*i)=='/' || (*i)=='%')){
+            const char w = *i;
+            i++;
+
+            Factor(i);
+            if(!err.succeeded)
+                return;
+
+            if(w=='*')
+                Emit(Op::Multiply, -1);
+            else if(w=='/')
+                Emit(Op::Divide, -1);
+            else
+                Emit(Op::Remainder, -1);
+
+            /* Arithmetic on arrays puts the result in the arena */
+            temporaries = true;
+
+            SkipWhitespace(i);
+        }
+    }
+
+    void Sum(const char *&i){
+        Term(i);
+        SkipWhitespace(i);
+
+        while(err.succeeded && i!=end && ((*i)=='-' || (*i)=='+')){
+            const char w = *i;
+            i++;
+
+            Term(i);
+            if(!err.succeeded)
+                return;
+
+            /* Concatenating strings and arithmetic on arrays put the result in the arena */
+            Emit(w=='+' ? Op::Add : Op::Subtract, -1);
+            temporaries = true;
+
+            SkipWhitespace(i);
+        }
+    }
+
+    /* `<sum> [= <> < <= > >= <sum>]' */
+    void Comparison(const char *&i){
+        Sum(i);
+        if(!err.succeeded || i==end)
+            return;
+
+        Op::Code op;
+        if((*i)=='=')
+            op = Op::Equal;
+        else if((*i)=='<')
+            op = (i+1!=end && i[1]=='>') ? Op::NotEqual : (i+1!=end && i[1]=='=') ? Op::LessEqual : Op::Less;
+        else if((*i)=='>')
+            op = (i+1!=end && i[1]=='=') ? Op::GreaterEqual : Op::Greater;
+        else
+            return;
+        i+=(op==Op::NotEqual || op==Op::LessEqual || op==Op::GreaterEqual) ? 2 : 1;
+
+        Sum(i);
+        if(err.succeeded)
+            Emit(op, -1);
+    }
+
+    /* Whether the next word is `word', moving past it if it is */
+    template<size_t N>
+    bool Keyword(const char *&i, const char (&word)[N]) const {
+        const char *at = i;
+        SkipWhitespace(at);
+        if(static_cast<size_t>(end-at)<N-1 || (*at)!=word[0] || !std::equal(word+1, word+N-1, at+1))
+            return false;
+        at+=N-1;
+        if(at!=end && !IsWhitespace(*at) && !IsSyntax(*at))
+            return false;
+        i = at;
+        SkipWhitespace(i);
+        return true;
+    }
+
+    /* Jumps whose targets are not known yet are chained through their
+        operands, each to the one emitted before it */
+    static const uint32_t Unresolved = 0xFFFFFFFF;
+
+    uint32_t Chain(Op::Code op, int pushes, uint32_t chain){
+        Emit<uint32_t>(op, pushes, chain);
+        return Here()-sizeof(uint32_t);
+    }
+
+    void Resolve(uint32_t chain, uint32_t to){
+        while(chain!=Unresolved){
+            uint64_t offset = chain;
+            const uint32_t next = Utils::GetObject<uint32_t>(&program.token_code.front(), offset);
+            Patch(chain, to);
+            chain = next;
+        }
+    }
+
+    /* Comparisons joined by `and' and `or', each of which may follow any
+        number of `not'. `not' binds most tightly, and `or' least. A single
+        comparison leaves its Value on the stack, and this returns false.
+        Otherwise the right side of each `and' and `or' is only reached when
+        the left does not decide, and this returns true with the code falling
+        through when the whole is true, and `falses' jumping when it is false.
+        Conditions branch on these directly rather than on a Value. */
+    bool Logic(const char *&i, uint32_t &falses){
+        /* `trues' skip the rest when an `or' is decided. `operand' are the
+            jumps out of the `and's since the last `or', which go on to the
+            next `or' if there is one. */
+        uint32_t trues = Unresolved, operand = Unresolved;
+        bool jumps = false;
+        for(;;){
+            unsigned nots = 0;
+            while(Keyword(i, "not"))
+                nots++;
+            Comparison(i);
+            if(!err.succeeded)
+                return false;
+            while(nots--)
+                Emit(Op::Not, 0);
+
+            if(Keyword(i, "and")){
+                operand = Chain(Op::JumpIfFalse, -1, operand);
+            }
+            else if(Keyword(i, "or")){
+                trues = Chain(Op::JumpIfTrue, -1, trues);
+                Resolve(operand, Here());
+                operand = Unresolved;
+            }
+            else{
+                break;
+            }
+            jumps = true;
+        }
+
+        if(!jumps)
+            return false;
+        falses = Chain(Op::JumpIfFalse, -1, operand);
+        Resolve(trues, Here());
+        return true;
+    }
+
+    /* An expression whose Value is left on the stack */
+    void Expression(const char *&i){
+        uint32_t falses = Unresolved;
+        if(!Logic(i, falses) || !err.succeeded)
+            return;
+
+        Emit<uint8_t>(Op::Boolean, 1, 1);
+        const uint32_t skip = EmitJump(Op::Jump, 0);
+        Resolve(falses, Here());
+        depth--;
+        Emit<uint8_t>(Op::Boolean, 1, 0);
+        Patch(skip, Here());
+    }
+
+    void Scope(const char *&i){
+        const struct Declaration *const outer = declared;
+        const uint32_t outer_slots = slots;
+        nesting++;
+
+        SkipWhitespace(i);
+        while(i!=end && (*i)!='.'){
+            Statement(i);
+            if(!err.succeeded)
+                return;
+            SkipWhitespace(i);
+        }
+
+        if(i==end){
+            Fail("Unexpected end of input before end of scope");
+            return;
+        }
+
+        /* Move off the '.' */
+        i++;
+        SkipWhitespace(i);
+
+        nesting--;
+        CloseScope(outer, outer_slots);
+    }
+
+    /* Compiles `<condition>:', returning the chain of jumps past the body,
+        and whether the condition's temporaries must be released after the
+        body too. */
+    uint32_t Condition(const char *&i, bool &release){
+        const char *const condition = i;
+        uint32_t falses = Unresolved;
+        const bool jumps = Logic(i, falses);
+        if(!err.succeeded)
+            return Unresolved;
+
+        SkipWhitespace(i);
+        if(i==end || (*i)!=':'){
+            Fail(std::string("Expected ':' after ") + std::string(condition, i));
+            return Unresolved;
+        }
+        i++;
+
+        if(!jumps)
+            falses = Chain(Op::JumpIfFalse, -1, falses);
+        release = ReleaseTemporaries();
+        return falses;
+    }
+
+    void If(const char *&i){
+        bool release;
+        const uint32_t jump = Condition(i, release);
+        if(!err.succeeded)
+            return;
+
+        Scope(i);
+        if(!err.succeeded)
+            return;
+
+        Resolve(jump, Here());
+        if(release)
+            Emit(Op::Release, 0);
+    }
+
+    void Loop(const char *&i){
+        const uint32_t start = Here();
+        NotInlinable();
+
+        bool release;
+        const uint32_t jump = Condition(i, release);
+        if(!err.succeeded)
+            return;
+
+        Scope(i);
+        if(!err.succeeded)
+            return;
+
+        Emit<uint32_t>(Op::Jump, 0, start);
+        Target(start, true);
+        Resolve(jump, Here());
+        if(release)
+            Emit(Op::Release, 0);
+    }
+
+    void Int(const char *&i){
+        const Token name = GetIdentifier(i);
+        SkipWhitespace(i);
+
+        if(name.Size()==0){
+            Fail("Expected a variable name after int");
+            return;
+        }
+
+        Expression(i);
+        if(!err.succeeded)
+            return;
+
+        const uint32_t symbol = Intern(name);
+        if(FindVariable(symbol)){
+            Fail(std::string("Variable ") + name.String() + " already exists");
+            return;
+        }
+
+        Emit<uint32_t>(Op::Declare, -1, slots);
+        Declare(symbol);
+    }
+
+    /* `ints <name> <length>' and `floats <name> <length>' declare arrays of zeros */
+    void Arrays(const char *&i, Array::Element element){
+        const Token name = GetIdentifier(i);
+        SkipWhitespace(i);
+
+        if(name.Size()==0){
+            Fail(std::string("Expected a variable name after ") + (element==Array::Integer ? "ints" : "floats"));
+            return;
+        }
+
+        Expression(i);
+        if(!err.succeeded)
+            return;
+
+        const uint32_t symbol = Intern(name);
+        if(FindVariable(symbol)){
+            Fail(std::string("Variable ") + name.String() + " already exists");
+            return;
+        }
+
+        Emit<uint8_t>(Op::NewArray, 0, element);
+        temporaries = true;
+        Emit<uint32_t>(Op::Store, -1, slots);
+        Declare(symbol);
+    }
+
+    void Set(const char *&i){
+        const Token name = GetIdentifier(i);
+        SkipWhitespace(i);
+
+        if(name.Is("local")){
+            const Token variable_name = GetIdentifier(i);
+            SkipWhitespace(i);
+
+            /* `set local <name> at <index> <expression>' sets an element */
+            const bool element = Keyword(i, "at");
+            if(element)
+                Primary(i);
+            if(err.succeeded)
+                Expression(i);
+            if(!err.succeeded)
+                return;
+
+            const struct Program::Local *const local = FindVariable(Find(variable_name));
+            if(!local){
+                Fail(std::string("Variable ") + variable_name.String() + " does not exist");
+                return;
+            }
+            if(element)
+                Emit<uint32_t>(Op::StoreElement, -2, local->slot);
+            else
+                Emit<uint32_t>(Op::Store, -1, local->slot);
+        }
+        else{
+            Expression(i);
+            if(!err.succeeded)
+                return;
+            SetProperty(0, Intern(name));
+        }
+    }
+
+    void To(const char *&i){
+        const Token module_name = GetIdentifier(i);
+        SkipWhitespace(i);
+
+        const Token name = GetIdentifier(i);
+        SkipWhitespace(i);
+
+        if(name.Is("local")){
+            Fail("Cannot set value \"local\" of remote object");
+            return;
+        }
+
+        Expression(i);
+        if(!err.succeeded)
+            return;
+        SetProperty(Intern(module_name), Intern(name));
+    }
+
+    void Wait(const char *&i){
+        const uint32_t start = Here();
+        NotInlinable();
+        Expression(i);
+        if(!err.succeeded)
+            return;
+        Emit<uint32_t>(Op::Wait, -1, start);
+        Target(start, true);
+    }
+
+    /* Finds the '.' that ends the scope `i' is in, without compiling it. A
+        '.' only ends a scope at the start of a word, since numbers and names
+        may have them. */
+    const char *EndOfScope(const char *i) const {
+        unsigned open = 1;
+        bool word = false;
+        while(i!=end){
+            const char c = *i++;
+            if(c=='"'){
+                while(i!=end && (*i)!='"') i++;
+                if(i!=end) i++;
+                word = false;
+            }
+            else if(c=='.' && !word){
+                if(--open==0)
+                    return i;
+            }
+            else{
+                if(c==':')
+                    open++;
+                word = !IsWhitespace(c) && !IsSyntax(c);
+            }
+        }
+        return NULL;
+    }
+
+    /* Keeps the source of a long procedure to be compiled when it is first
+        called. Its body starts at `i', and `statement' is at its `proc'. */
+    bool Defer(const char *&i){
+        const char *const after = EndOfScope(i);
+        if(!after || static_cast<uint32_t>(after-i)<MinDeferredSize)
+            return false;
+
+        definitions->inlinable = false;
+        const struct Procedure procedure = {&program, definitions->symbol, 0, definitions->arguments, 0, 0, NULL};
+        program.token_procedure_table.push_back(procedure);
+
+        const struct Program::Line &at = program.lines.back();
+        const struct Program::Deferred deferred = {definitions->index,
+            static_cast<uint32_t>(program.deferred_source.size()), static_cast<uint32_t>(after-statement),
+            at.line, at.column, NULL};
+        program.deferred.push_back(deferred);
+        program.deferred_source.insert(program.deferred_source.end(), statement, after);
+
+        i = after;
+        SkipWhitespace(i);
+        return true;
+    }
+
+    /* `proc <name> <parameters>: <body> .' The body is skipped over where it
+        is defined, and runs in its own frame with the arguments in its first
+        slots. */
+    void Proc(const char *&i){
+        if(nesting!=0 || defining){
+            Fail("Procedures can only be defined at the top of a script");
+            return;
+        }
+
+        const Token name = GetIdentifier(i);
+        SkipWhitespace(i);
+
+        if(name.Size()==0){
+            Fail("Expected a procedure name after proc");
+            return;
+        }
+
+        const uint32_t symbol = Intern(name);
+        if(FindDefinition(symbol)){
+            Fail(std::string("Procedure ") + name.String() + " already exists");
+            return;
+        }
+
+        /* Count the parameters before reading them into the arena */
+        uint32_t arguments = 0;
+        for(const char *p = i; p!=end && (*p)!=':'; arguments++){
+            if(GetIdentifier(p).Size()==0){
+                Fail(std::string("Expected a parameter name or ':' after proc ") + name.String());
+                return;
+            }
+            SkipWhitespace(p);
+        }
+
+        uint32_t *const parameters =
+            static_cast<uint32_t *>(arena.Allocate(sizeof(uint32_t)*(arguments+1)));
+        for(uint32_t n = 0; n<arguments; n++)
+            parameters[n] = Intern(GetIdentifier(i));
+        SkipWhitespace(i);
+
+        if(i==end){
+            Fail(std::string("Expected ':' after proc ") + name.String());
+            return;
+        }
+        i++;
+
+        struct Definition *const d =
+            static_cast<struct Definition *>(arena.Allocate(sizeof(struct Definition)));
+        d->symbol = symbol;
+        d->index = program.token_procedure_table.size();
+        d->arguments = arguments;
+        d->parameters = parameters;
+        d->body = i;
+        d->inlinable = true;
+        d->next = definitions;
+        definitions = d;
+
+        if(lazy && Defer(i))
+            return;
+
+        const uint32_t skip = EmitJump(Op::Jump, 0);
+        const struct Procedure procedure = {&program, symbol, Here(), arguments, 0, 0, &program};
+        program.token_procedure_table.push_back(procedure);
+
+        /* The procedure gets a frame of its own */
+        const struct Declaration *const outer = declared;
+        const uint32_t outer_slots = slots, outer_depth = depth,
+            outer_frame_slots = frame_slots, outer_frame_stack = frame_stack,
+            outer_first_local = first_local;
+        slots = depth = frame_slots = frame_stack = 0;
+        first_local = program.locals.size();
+        defining = d;
+        returned = false;
+
+        for(uint32_t n = 0; n<arguments; n++){
+            if(FindVariable(parameters[n])){
+                Fail(std::string("Procedure ") + name.String() + " has two parameters named " +
+                    symbols.Name(parameters[n]));
+                return;
+            }
+            Declare(parameters[n]);
+        }
+
+        Scope(i);
+        if(!err.succeeded)
+            return;
+
+        /* Returning destroys the parameters */
+        CloseScope(outer, slots);
+        Emit(Op::Null, 1);
+        Emit(Op::Return, -1);
+
+        /* Only short procedures are worth copying into each caller */
+        if(Here()-procedure.entry>MaxInlineSize)
+            d->inlinable = false;
+
+        program.token_procedure_table[d->index].slots = frame_slots;
+        program.token_procedure_table[d->index].stack = frame_stack;
+
+        slots = outer_slots;
+        depth = outer_depth;
+        frame_slots = outer_frame_slots;
+        frame_stack = outer_frame_stack;
+        first_local = outer_first_local;
+        defining = NULL;
+        returned = false;
+
+        Patch(skip, Here());
+    }
+
+    /* `return [<expression>]' Without an expression, the result is Null. */
+    void Return(const char *&i){
+        if(!defining && !inlining){
+            Fail("Cannot return outside of a procedure");
+            return;
+        }
+
+        if(StartsFactor(i))
+            Expression(i);
+        else
+            Emit(Op::Null, 1);
+        if(!err.succeeded)
+            return;
+
+        if(inlining){
+            /* The result outlives the variables of the inlined procedure */
+            if(last==Op::Load)
+                Emit(Op::Detach, 0);
+            temporaries = true;
+            inline_returned = true;
+            return;
+        }
+
+        Emit(Op::Return, -1);
+        if(nesting==1)
+            returned = true;
+        else
+            NotInlinable();
+    }
+
+    void Statement(const char *&i){
+        SkipWhitespace(i);
+        const char *const start = i, *const outer = statement;
+        statement = start;
+        Locate(start);
+        const Token word = GetIdentifier(i);
+        SkipWhitespace(i);
+
+        /* Anything after a return is only reached by jumping, so an inlined
+            procedure must return at its end */
+        if(returned && !inlining)
+            NotInlinable();
+
+        if(word.Is("int")){
+            Int(i);
+        }
+        else if(word.Is("ints")){
+            Arrays(i, Array::Integer);
+        }
+        else if(word.Is("floats")){
+            Arrays(i, Array::Floating);
+        }
+        else if(word.Is("if")){
+            If(i);
+        }
+        else if(word.Is("loop")){
+            Loop(i);
+        }
+        else if(word.Is("set")){
+            Set(i);
+        }
+        else if(word.Is("to")){
+            To(i);
+        }
+        else if(word.Is("yield")){
+            NotInlinable();
+            Emit(Op::Yield, 0);
+        }
+        else if(word.Is("wait")){
+            Wait(i);
+        }
+        else if(word.Is("proc")){
+            Proc(i);
+        }
+        else if(word.Is("return")){
+            Return(i);
+        }
+        else if(word.Is("call") || word.Is("from")){
+            /* A call for its effects, or a property read for none */
+            i = start;
+            Factor(i);
+            if(err.succeeded)
+                Emit(Op::Drop, -1);
+        }
+        else{
+            Fail(std::string("Expected statement at \"") + word.String() + '"');
+            return;
+        }
+
+        /* Nothing but variables outlives a statement */
+        if(err.succeeded)
+            ReleaseTemporaries();
+        statement = outer;
+    }
+
+    /* The script itself is the outermost scope */
+    void Script(const char *&i){
+        SkipWhitespace(i);
+        while(i!=end && err.succeeded)
+            Statement(i);
+
+        if(err.succeeded){
+            CloseScope(NULL, 0);
+            Emit(Op::End, 0);
+            program.slots = frame_slots;
+            program.stack = frame_stack;
+        }
+    }
+
+};
+
+static struct Error Compile(const char *source, size_t length, struct Program &program, const Context &context,
+    Arena &arena, SymbolTable &symbols, bool constants, bool lazy){
+    program.Clear();
+    program.digest = Program::Digest(source, length);
+    program.length = length;
+    const size_t title = length<Program::MaxTitle ? length : Program::MaxTitle;
+    program.title.assign(source, std::find(source, source+title, '\n'));
+
+    const Arena::Mark mark = arena.GetMark();
+
+    Compiler compiler(program, context, arena, symbols, constants, lazy, source, source+length);
+    const char *i = source;
+    compiler.Script(i);
+
+    arena.Release(mark);
+    return compiler.err;
+}
+
+struct Error Compile(const char *source, size_t length, struct Program &program, const Context &context, Arena &arena){
+    return Compile(source, length, program, context, arena, Symbols(), true, context.IsLazy());
+}
+
+struct Error Compile(const char *source, size_t length, struct Program &program, const Context &context, Arena &arena,
+    SymbolTable &symbols){
+    return Compile(source, length, program, context, arena, symbols, false, context.IsLazy());
+}
+
+struct Error CompileDeferred(const struct Program &owner, uint32_t procedure, struct Program &program,
+    const Context &context, Arena &arena){
+    const struct Program::Deferred *d = NULL;
+    for(size_t i = 0; i<owner.deferred.size() && !d; i++){
+        if(owner.deferred[i].procedure==procedure)
+            d = &owner.deferred[i];
+    }
+
+    const struct Error err = Compile(&owner.deferred_source[d->offset], d->size, program, context, arena,
+        Symbols(), true, false);
+
+    /* It is named, and its lines counted, as part of the script it was in */
+    program.title.assign(owner.title.begin(), owner.title.end());
+    for(size_t i = 0; i<program.lines.size(); i++){
+        struct Program::Line &l = program.lines[i];
+        if(l.line==1)
+            l.column+=d->column-1;
+        l.line+=d->line-1;
+    }
+    return err;
+}
+
+} // namespace Lithium
@@ -0,0 +1,26 @@
+#pragma once
+#include "lithium.hpp"
+#include "program.hpp"
+#include "arena.hpp"
+
+namespace Lithium{
+
+/* Compiles ICL into `program', replacing anything it held. Properties are
+    read as `context' binds them, so Constant Accessors are read while
+    compiling. If the Context is lazy, long procedures are deferred. Any
+    scratch memory is taken from `arena' and released before returning. */
+struct Error Compile(const char *source, size_t length, struct Program &program, const Context &context, Arena &arena);
+
+/* The same, away from the Context's thread. New names are interned in
+    `symbols', which must be layered on Symbols(), so the program may hold
+    Scratch symbols. Constant Accessors are not called, and are read as if
+    they were Stable. */
+struct Error Compile(const char *source, size_t length, struct Program &program, const Context &context, Arena &arena,
+    SymbolTable &symbols);
+
+/* Compiles deferred procedure `procedure' of `owner' as the only procedure
+    of `program', such as when it is first called */
+struct Error CompileDeferred(const struct Program &owner, uint32_t procedure, struct Program &program,
+    const Context &context, Arena &arena);
+
+}
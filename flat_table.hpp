@@ -0,0 +1,186 @@
+#pragma once
+#include "heap.hpp"
+#include <cstring>
+#include <stdint.h>
+
+namespace Lithium{
+namespace Utils{
+
+/* An open addressed hash table from symbols to values, with the values stored
+    inline next to their keys. Keys are non-zero symbols (see SymbolTable), and
+    V must be a plain old data type, since entries are moved with memcpy. */
+template<typename V>
+class FlatTable{
+public:
+    
+    struct Entry{
+        uint32_t key;
+        V value;
+    };
+    
+private:
+    
+    Entry *entries;
+    uint32_t capacity, count;
+    Heap *heap;
+    
+    static uint32_t Hash(uint32_t key){
+        key *= 2654435761u;
+        return key ^ (key>>16);
+    }
+    
+    Entry *Allocate(uint32_t n){
+        Entry *const e = (Entry *)heap->Allocate(sizeof(Entry)*n);
+        for(uint32_t i = 0; i<n; i++)
+            e[i].key = 0;
+        return e;
+    }
+    
+    Entry *Probe(uint32_t key) const {
+        const uint32_t mask = capacity-1;
+        uint32_t i = Hash(key)&mask;
+        while(entries[i].key!=0 && entries[i].key!=key)
+            i = (i+1)&mask;
+        return entries+i;
+    }
+    
+    void Copy(const FlatTable &that){
+        if(capacity){
+            entries = (Entry *)heap->Allocate(sizeof(Entry)*capacity);
+            memcpy(entries, that.entries, sizeof(Entry)*capacity);
+        }
+    }
+    
+    void Resize(uint32_t to){
+        Entry *const old = entries;
+        const uint32_t old_capacity = capacity;
+        
+        entries = Allocate(to);
+        capacity = to;
+        
+        for(uint32_t i = 0; i<old_capacity; i++){
+            if(old[i].key!=0)
+                memcpy(Probe(old[i].key), old+i, sizeof(Entry));
+        }
+        
+        heap->Release(old, sizeof(Entry)*old_capacity);
+    }
+    
+public:
+    
+    FlatTable()
+      : entries(NULL), capacity(0), count(0), heap(&GlobalHeap()){}
+    
+    explicit FlatTable(Heap *h)
+      : entries(NULL), capacity(0), count(0), heap(h){}
+    
+    FlatTable(const FlatTable &that)
+      : entries(NULL), capacity(that.capacity), count(that.count), heap(that.heap){
+        Copy(that);
+    }
+    
+    /* Copies that, with the copy allocated from h */
+    FlatTable(const FlatTable &that, Heap *h)
+      : entries(NULL), capacity(that.capacity), count(that.count), heap(h){
+        Copy(that);
+    }
+    
+    ~FlatTable(){
+        heap->Release(entries, sizeof(Entry)*capacity);
+    }
+    
+    FlatTable &operator=(const FlatTable &that){
+        if(this!=&that){
+            FlatTable copy(that);
+            Swap(copy);
+        }
+        return *this;
+    }
+    
+    void Swap(FlatTable &that){
+        Entry *const e = entries; entries = that.entries; that.entries = e;
+        const uint32_t c = capacity; capacity = that.capacity; that.capacity = c;
+        const uint32_t n = count; count = that.count; that.count = n;
+        Heap *const h = heap; heap = that.heap; that.heap = h;
+    }
+    
+    inline Heap *GetHeap() const { return heap; }
+    
+    inline uint32_t Size() const { return count; }
+    inline uint32_t Capacity() const { return capacity; }
+    
+    /* Bytes of storage held by the table, not counting the table itself. */
+    inline uint64_t Bytes() const { return sizeof(Entry)*(uint64_t)capacity; }
+    
+    /* Iteration is over all slots. Empty slots have a key of 0. */
+    inline const Entry *Slot(uint32_t i) const { return entries+i; }
+    inline Entry *Slot(uint32_t i){ return entries+i; }
+    
+    const V *Find(uint32_t key) const {
+        if(count==0) return NULL;
+        const Entry *const e = Probe(key);
+        return (e->key==0) ? NULL : &(e->value);
+    }
+    
+    V *Find(uint32_t key){
+        if(count==0) return NULL;
+        Entry *const e = Probe(key);
+        return (e->key==0) ? NULL : &(e->value);
+    }
+    
+    /* Returns the value for key, adding it with an undefined value if needed */
+    V &operator[](uint32_t key){
+        if(capacity==0)
+            Resize(8);
+        
+        Entry *e = Probe(key);
+        if(e->key==0){
+            /* Keep the load at or under three quarters */
+            if((count+1)*4 > capacity*3){
+                Resize(capacity<<1);
+                e = Probe(key);
+            }
+            e->key = key;
+            count++;
+        }
+        return e->value;
+    }
+    
+    /* Removes all keys, keeping the storage */
+    void Clear(){
+        for(uint32_t i = 0; i<capacity && count!=0; i++){
+            if(entries[i].key!=0){
+                entries[i].key = 0;
+                count--;
+            }
+        }
+    }
+    
+    /* Removes key, shifting back any entries that probed past it. */
+    bool Erase(uint32_t key){
+        if(count==0) return false;
+        
+        Entry *e = Probe(key);
+        if(e->key==0) return false;
+        
+        const uint32_t mask = capacity-1;
+        uint32_t hole = e-entries;
+        for(uint32_t i = (hole+1)&mask; entries[i].key!=0; i = (i+1)&mask){
+            const uint32_t home = Hash(entries[i].key)&mask;
+            /* Move the entry into the hole unless its home lies cyclically
+                in (hole, i], in which case it is already reachable. */
+            const bool reachable = (hole<=i) ? (home>hole && home<=i) : (home>hole || home<=i);
+            if(!reachable){
+                memcpy(entries+hole, entries+i, sizeof(Entry));
+                hole = i;
+            }
+        }
+        entries[hole].key = 0;
+        count--;
+        return true;
+    }
+    
+};
+
+} // namespace Utils
+} // namespace Lithium
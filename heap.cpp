@@ -0,0 +1,97 @@
+#include "heap.hpp"
+#include <cstdlib>
+
+namespace Lithium{
+
+static void *DefaultAllocate(void *, size_t size){
+    return malloc(size);
+}
+
+static void *DefaultReallocate(void *, void *at, size_t, size_t new_size){
+    return realloc(at, new_size);
+}
+
+static void DefaultRelease(void *, void *at, size_t){
+    free(at);
+}
+
+static const struct Allocator default_allocator = {DefaultAllocate, DefaultReallocate, DefaultRelease, NULL};
+
+Heap::Heap(const struct Allocator &a)
+  : allocator(a)
+  , orphaned(false){
+    stats.bytes = stats.allocations = stats.peak_bytes = stats.total_allocations = 0;
+}
+
+Heap *Heap::Create(const struct Allocator &a){
+    void *const at = a.allocate(a.user, sizeof(Heap));
+    return new(at) Heap(a);
+}
+
+void Heap::Destroy(){
+    const struct Allocator a = allocator;
+    this->~Heap();
+    a.release(a.user, this, sizeof(Heap));
+}
+
+void Heap::Orphan(){
+    orphaned = true;
+    if(stats.allocations==0)
+        Destroy();
+}
+
+void *Heap::Allocate(size_t size){
+    stats.bytes+=size;
+    stats.allocations++;
+    stats.total_allocations++;
+    if(stats.bytes>stats.peak_bytes)
+        stats.peak_bytes = stats.bytes;
+    return allocator.allocate(allocator.user, size);
+}
+
+void *Heap::Reallocate(void *at, size_t old_size, size_t new_size){
+    if(!at)
+        return Allocate(new_size);
+    stats.bytes+=new_size;
+    stats.bytes-=old_size;
+    if(stats.bytes>stats.peak_bytes)
+        stats.peak_bytes = stats.bytes;
+    return allocator.reallocate(allocator.user, at, old_size, new_size);
+}
+
+void Heap::Release(void *at, size_t size){
+    if(!at)
+        return;
+    allocator.release(allocator.user, at, size);
+    stats.bytes-=size;
+    stats.allocations--;
+    if(orphaned && stats.allocations==0)
+        Destroy();
+}
+
+/* The default global heap is never destroyed. Heaps that replace it are
+    orphaned when they are replaced in turn, and go away once everything
+    allocated from them has. */
+static Heap *global_heap = NULL;
+
+static Heap &DefaultHeap(){
+    static Heap default_heap(default_allocator);
+    return default_heap;
+}
+
+Heap &GlobalHeap(){
+    return global_heap ? *global_heap : DefaultHeap();
+}
+
+void SetAllocator(const struct Allocator &a){
+    Heap *const previous = global_heap;
+    global_heap = Heap::Create(a);
+    if(previous)
+        previous->Orphan();
+}
+
+const struct Allocator &GetAllocator(){
+    return GlobalHeap().GetAllocator();
+}
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <stdint.h>
+
+namespace Lithium{
+
+/* Hooks for all memory that Lithium allocates. `user' is passed back to each
+    hook. Sizes are always given, so the hooks may be backed by sized pools. */
+struct Allocator{
+    void *(*allocate)(void *user, size_t size);
+    void *(*reallocate)(void *user, void *at, size_t old_size, size_t new_size);
+    void (*release)(void *user, void *at, size_t size);
+    void *user;
+};
+
+struct MemoryStats{
+    /* Bytes and allocations currently live */
+    uint64_t bytes, allocations;
+    /* Over the lifetime of the Heap */
+    uint64_t peak_bytes, total_allocations;
+};
+
+/* An Allocator with accounting. Every allocation keeps its Heap alive, so
+    that memory that outlives its owner (such as tables shared between
+    Contexts) is still released to the right place. Heaps are not thread safe. */
+class Heap{
+    struct Allocator allocator;
+    struct MemoryStats stats;
+    bool orphaned;
+    
+    void Destroy();
+    
+public:
+    
+    explicit Heap(const struct Allocator &a);
+    
+    /* Creates a Heap that is itself allocated with `a'. */
+    static Heap *Create(const struct Allocator &a);
+    
+    /* Called by the owner of a Created Heap when it is done with it. The Heap
+        destroys itself once all of its allocations are released. */
+    void Orphan();
+    
+    void *Allocate(size_t size);
+    void *Reallocate(void *at, size_t old_size, size_t new_size);
+    void Release(void *at, size_t size);
+    
+    inline const struct MemoryStats &Stats() const { return stats; }
+    inline const struct Allocator &GetAllocator() const { return allocator; }
+    
+};
+
+/* The Heap used for memory that does not belong to any Context, and the
+    default for new Contexts. Setting the global allocator only affects later
+    allocations, and should be done before any Contexts are created. */
+Heap &GlobalHeap();
+void SetAllocator(const struct Allocator &a);
+const struct Allocator &GetAllocator();
+
+namespace Utils{
+
+/* Adapts a Heap for the standard containers */
+template<typename T>
+struct HeapAllocator{
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template<typename U> struct rebind{ typedef HeapAllocator<U> other; };
+    
+    Heap *heap;
+    
+    HeapAllocator()
+      : heap(&GlobalHeap()){}
+    explicit HeapAllocator(Heap *h)
+      : heap(h){}
+    template<typename U> HeapAllocator(const HeapAllocator<U> &that)
+      : heap(that.heap){}
+    
+    pointer address(reference r) const { return &r; }
+    const_pointer address(const_reference r) const { return &r; }
+    
+    pointer allocate(size_type n, const void * = 0){
+        return static_cast<pointer>(heap->Allocate(n*sizeof(T)));
+    }
+    void deallocate(pointer p, size_type n){
+        heap->Release(p, n*sizeof(T));
+    }
+    size_type max_size() const { return std::numeric_limits<size_type>::max()/sizeof(T); }
+    void construct(pointer p, const T &t){ new(static_cast<void *>(p)) T(t); }
+    void destroy(pointer p){ p->~T(); }
+};
+
+template<typename T, typename U>
+bool operator==(const HeapAllocator<T> &a, const HeapAllocator<U> &b){ return a.heap==b.heap; }
+template<typename T, typename U>
+bool operator!=(const HeapAllocator<T> &a, const HeapAllocator<U> &b){ return a.heap!=b.heap; }
+
+} // namespace Utils
+} // namespace Lithium
@@ -1,9 +1,16 @@
 #include "lithium.hpp"
 #include "bytecode_utils.hpp"
+#include "program.hpp"
+#include "array_utils.hpp"
+#include "compiler.hpp"
+#include "verifier.hpp"
+#include "optimizer.hpp"
+#include "profiler.hpp"
 #include "strtoll.h"
 #include <algorithm>
 #include <cstdlib>
 #include <cmath>
+#include <cstdio>
 
 namespace Lithium{
 
@@ -42,31 +49,260 @@ struct remainder {
     }
 };
 
+/* Integers wrap around rather than overflowing, as the optimizer folds them */
 template<>
-struct remainder<double> {
-    double operator() (const double a, const double b) const {
-        return fmod(a, b);
+struct plus<int64_t> {
+    int64_t operator() (const int64_t a, const int64_t b) const {
+        return static_cast<int64_t>(static_cast<uint64_t>(a)+static_cast<uint64_t>(b));
+    }
+};
+
+template<>
+struct minus<int64_t> {
+    int64_t operator() (const int64_t a, const int64_t b) const {
+        return static_cast<int64_t>(static_cast<uint64_t>(a)-static_cast<uint64_t>(b));
+    }
+};
+
+template<>
+struct multiply<int64_t> {
+    int64_t operator() (const int64_t a, const int64_t b) const {
+        return static_cast<int64_t>(static_cast<uint64_t>(a)*static_cast<uint64_t>(b));
+    }
+};
+
+/* The lowest integer divided by -1 does not fit, and traps rather than
+    overflowing. It wraps around to itself instead, with no remainder. */
+template<>
+struct divide<int64_t> {
+    int64_t operator() (const int64_t a, const int64_t b) const {
+        return (b==-1) ? static_cast<int64_t>(0-static_cast<uint64_t>(a)) : a/b;
+    }
+};
+
+template<>
+struct remainder<int64_t> {
+    int64_t operator() (const int64_t a, const int64_t b) const {
+        return (b==-1) ? 0 : a%b;
     }
 };
 
 template<>
-struct remainder<float> {
-    float operator() (const float a, const float b) const {
+struct remainder<double> {
+    double operator() (const double a, const double b) const {
         return fmod(a, b);
     }
 };
 
-Context::Context(){
+static char *CopyString(Heap *heap, const char *str){
+    const size_t len = strlen(str);
+    char *const to = (char *)heap->Allocate(len+1);
+    memcpy(to, str, len+1);
+    return to;
+}
+
+static void FreeString(Heap *heap, char *str){
+    if(str)
+        heap->Release(str, strlen(str)+1);
+}
+
+/* Arrays made here have their elements directly after them, allocated from
+    either a Heap or an Arena */
+static inline size_t ArrayBytes(uint32_t length){
+    return sizeof(struct Array)+sizeof(int64_t)*length;
+}
+
+template<class A>
+static struct Array *AllocateArray(A &allocator, Array::Element element, uint32_t length){
+    struct Array *const a = static_cast<struct Array *>(allocator.Allocate(ArrayBytes(length)));
+    a->element = element;
+    a->length = length;
+    if(element==Array::Integer)
+        a->data.integer = reinterpret_cast<int64_t *>(a+1);
+    else
+        a->data.floating = reinterpret_cast<double *>(a+1);
+    return a;
+}
+
+template<class A>
+static struct Array *CopyArray(A &allocator, const struct Array &from){
+    struct Array *const to = AllocateArray(allocator, from.element, from.length);
+    memcpy(to+1, from.data.integer, sizeof(int64_t)*from.length);
+    return to;
+}
+
+/* Only for what CopyArray allocated from `heap' */
+static void FreeValue(Heap *heap, const struct Value &v){
+    if(v.type==Value::String)
+        FreeString(heap, v.value.string);
+    else if(v.type==Value::Array)
+        heap->Release(v.value.array, ArrayBytes(v.value.array->length));
+}
+
+/* Variables own their strings and arrays, allocated from the heap of their
+    Context, since the Values they are set from may point into the arena of an
+    execution or into the host's memory. */
+static void StoreVariable(Heap *heap, struct Value &to, const struct Value &v){
+    const struct Value old = to;
+    to = v;
+    if(v.type==Value::String)
+        to.value.string = CopyString(heap, v.value.string);
+    else if(v.type==Value::Array)
+        to.value.array = CopyArray(*heap, *v.value.array);
+    FreeValue(heap, old);
+}
+
+static void FreeVariables(struct Value *slots, uint32_t count, Heap *heap){
+    for(uint32_t i = 0; i<count; i++){
+        FreeValue(heap, slots[i]);
+        slots[i].type = Value::Null;
+    }
+}
+
+Context::Context()
+  : heap(NULL)
+  , program(NULL)
+  , running(NULL)
+  , suspended(NULL)
+  , profiler(NULL)
+  , hooks()
+  , hooked(false)
+  , lazy(false)
+  , reactive(false)
+  , watched(false)
+  , published(false)
+  , stats()
+  , allocations_before(0){
 
 }
     
 Context::Context(void *obj)
-  : object(obj){
+  : object(obj)
+  , heap(NULL)
+  , program(NULL)
+  , running(NULL)
+  , suspended(NULL)
+  , profiler(NULL)
+  , hooks()
+  , hooked(false)
+  , lazy(false)
+  , reactive(false)
+  , watched(false)
+  , published(false)
+  , stats()
+  , allocations_before(0){
+    
+}
+
+Context::Context(void *obj, const Context &prototype)
+  : properties(prototype.properties)
+  , modules(prototype.modules)
+  , intrinsics(prototype.intrinsics)
+  , object(obj)
+  , heap(NULL)
+  , program(NULL)
+  , running(NULL)
+  , suspended(NULL)
+  , profiler(NULL)
+  , hooks()
+  , hooked(false)
+  , lazy(false)
+  , reactive(false)
+  , watched(false)
+  , published(false)
+  , stats()
+  , allocations_before(0){
     
 }
 
+Script::Script()
+  : program(NULL){}
+
+Script::Script(struct Program *p)
+  : program(p){
+    p->Retain();
+}
+
+Script::Script(const Script &that)
+  : program(that.program){
+    if(program)
+        program->Retain();
+}
+
+Script &Script::operator=(const Script &that){
+    if(that.program)
+        that.program->Retain();
+    if(program)
+        program->Release();
+    program = that.program;
+    return *this;
+}
+
+Script::~Script(){
+    if(program)
+        program->Release();
+}
+
 Context::~Context(){
+    Cancel();
+    for(uint32_t i = 0; i<token_procedure_table.Capacity(); i++){
+        if(token_procedure_table.Slot(i)->key!=0)
+            token_procedure_table.Slot(i)->value->program->Release();
+    }
+    if(program)
+        program->Release();
+    cache.SetHeap(NULL);
+    FreeSnapshot();
+    /* Anything still allocated from the heap releases it once freed */
+    if(heap)
+        heap->Orphan();
+}
+
+Heap *Context::GetHeap(){
+    if(!heap)
+        heap = Heap::Create(Lithium::GetAllocator());
+    return heap;
+}
+
+void Context::SetAllocator(const struct Allocator &a){
+    Heap *const previous = heap;
+    if(program)
+        program->Release();
+    program = NULL;
+    cache.SetHeap(NULL);
+    heap = Heap::Create(a);
+    allocations_before = 0;
+    arena.SetHeap(heap);
+    if(previous)
+        previous->Orphan();
+}
 
+void Context::SetHooks(const struct Hooks *h){
+    hooked = h!=NULL;
+    if(h)
+        hooks = *h;
+}
+
+struct ExecutionStats Context::GetExecutionStats() const {
+    struct ExecutionStats s = stats;
+    s.allocations = heap ? heap->Stats().total_allocations-allocations_before : 0;
+    return s;
+}
+
+void Context::ResetExecutionStats(){
+    const struct ExecutionStats none = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    stats = none;
+    allocations_before = heap ? heap->Stats().total_allocations : 0;
+}
+
+struct MemoryStats Context::GetMemoryStats() const {
+    if(heap){
+        return heap->Stats();
+    }
+    else{
+        const struct MemoryStats stats = {0, 0, 0, 0};
+        return stats;
+    }
 }
 
 struct Error Context::AddModule(const std::string &name, Context *ctx){
@@ -75,119 +311,320 @@ struct Error Context::AddModule(const std::string &name, Context *ctx){
         return e;
     }
     else{
-        modules[name] = ctx;
+        const uint32_t symbol = Symbols().Intern(name);
+        modules.Write(GetHeap())[symbol] = ctx;
+        cache.Clear();
+        Changed(symbol);
         const struct Error e = {true};
         return e;
     }
 }
 
 struct Error Context::RemoveModule(const std::string &name){
-    std::map<std::string, Context *>::iterator i = modules.find(name);
-    if(i==modules.end()){
+    const uint32_t symbol = Symbols().Find(name);
+    if(!modules->Find(symbol)){
         struct Error e = {false, std::string("Module ") + name + " does not exist"};
         return e;
     }
     else{
         struct Error e = {true};
-        modules.erase(i);
+        modules.Write(GetHeap()).Erase(symbol);
+        cache.Clear();
+        Changed(symbol);
         return e;
     }
 }
 
 struct Error Context::SetModule(const std::string &name, Context *ctx){
-    std::map<std::string, Context *>::iterator i = modules.find(name);
-    if(i==modules.end()){
+    const uint32_t symbol = Symbols().Find(name);
+    if(!modules->Find(symbol)){
         struct Error e = {false, std::string("Module ") + name + " does not exist"};
         return e;
     }
     else{
-        i->second = ctx;
+        modules.Write(GetHeap())[symbol] = ctx;
+        cache.Clear();
+        Changed(symbol);
         struct Error e = {true};
         return e;
     }
 }
 
 Context *Context::GetModule(const std::string &name){
+    return GetModule(Symbols().Find(name));
+}
 
-    std::map<std::string, Context *>::const_iterator i = modules.find(name);
-    if(i==modules.end()) return NULL;
-    return i->second;
+Context *Context::GetModule(uint32_t symbol) const {
+    Context *const *const m = modules->Find(symbol);
+    return m ? *m : NULL;
 }
         
-struct Error Context::AddAccessor(const std::string &name, Accessor a){
+struct Error Context::AddBinding(const std::string &name, const struct Binding &b){
     
-    if(GetAccessor(name)){
-        const struct Error e = {false, std::string("Accessor ") + name + " already exists"};
+    const uint32_t symbol = Symbols().Intern(name);
+    if(properties->Find(symbol)){
+        const struct Error e = {false, std::string("Property ") + name + " already exists"};
         return e;
     }
     /* else */ {
-        accessors[name] = a;
+        properties.Write(GetHeap())[symbol] = b;
+        cache.Clear();
+        Changed(symbol);
         const struct Error e = {true};
         return e;
     }
 }
 
-Accessor Context::GetAccessor(const std::string &name){
+struct Error Context::AddAccessor(const std::string &name, Accessor a, Purity purity){
+    struct Binding b;
+    b.kind = Binding::Callback;
+    b.type = Value::Null;
+    b.purity = purity;
+    b.bind.accessor = a;
+    return AddBinding(name, b);
+}
 
-    std::map<std::string, Accessor>::iterator i = accessors.find(name);
+struct Error Context::AddProperty(const std::string &name, IntegerGetter get, IntegerSetter set){
+    struct Binding b;
+    b.kind = Binding::Typed;
+    b.purity = Volatile;
+    b.type = Value::Integer;
+    b.bind.integer.get = get;
+    b.bind.integer.set = set;
+    return AddBinding(name, b);
+}
+
+struct Error Context::AddProperty(const std::string &name, FloatingGetter get, FloatingSetter set){
+    struct Binding b;
+    b.kind = Binding::Typed;
+    b.purity = Volatile;
+    b.type = Value::Floating;
+    b.bind.floating.get = get;
+    b.bind.floating.set = set;
+    return AddBinding(name, b);
+}
 
-    if(i==accessors.end()) return NULL;
-    return i->second;
+struct Error Context::AddProperty(const std::string &name, BooleanGetter get, BooleanSetter set){
+    struct Binding b;
+    b.kind = Binding::Typed;
+    b.purity = Volatile;
+    b.type = Value::Boolean;
+    b.bind.boolean.get = get;
+    b.bind.boolean.set = set;
+    return AddBinding(name, b);
 }
 
-struct Error Context::AddVariable(const std::string &name, struct Value &v){
-    if(GetVariable(name).type!=Value::Null){
-        const struct Error e = {false, std::string("Variable ") + name + " already exists"};
+struct Error Context::AddIntrinsic(const std::string &name, Intrinsic::Code code){
+    const uint32_t symbol = Symbols().Intern(name);
+    if(intrinsics->Find(symbol)){
+        const struct Error e = {false, std::string("Intrinsic ") + name + " already exists"};
         return e;
     }
-    /* else */ {
-        variables[name] = v;
+    else{
+        intrinsics.Write(GetHeap())[symbol] = static_cast<uint8_t>(code);
+        cache.Clear();
+        Changed(symbol);
         const struct Error e = {true};
         return e;
     }
 }
 
+struct Error Context::SetAccessor(const std::string &name, Accessor a, Purity purity){
+    const uint32_t symbol = Symbols().Find(name);
+    if(!properties->Find(symbol)){
+        struct Error e = {false, std::string("Property ") + name + " does not exist"};
+        return e;
+    }
+    else{
+        struct Binding &b = properties.Write(GetHeap())[symbol];
+        b.kind = Binding::Callback;
+        b.type = Value::Null;
+        b.purity = purity;
+        b.bind.accessor = a;
+        cache.Clear();
+        Changed(symbol);
+        struct Error e = {true};
+        return e;
+    }
+}
+
+Accessor Context::GetAccessor(const std::string &name){
+
+    const struct Binding *const b = properties->Find(Symbols().Find(name));
+
+    if(!b || b->kind!=Binding::Callback) return NULL;
+    return b->bind.accessor;
+}
+
+struct Value *Context::FindVariable(uint32_t symbol) const {
+    const struct Execution *const e = running ? running : suspended;
+    if(!e || !symbol)
+        return NULL;
+    
+    /* A procedure is found in the Program that runs it by its entry, since
+        a deferred one is not of that Program */
+    const struct Program &p = *e->program;
+    uint32_t frame = 0;
+    for(size_t i = 0; e->procedure && i<p.token_procedure_table.size() && !frame; i++){
+        if(p.token_procedure_table[i].entry==e->procedure->entry)
+            frame = i+1;
+    }
+    
+    const struct Program::Local *const local = p.FindLocal(symbol, e->pc, frame);
+    return local ? e->slots + local->slot : NULL;
+}
+
 struct Value Context::GetVariable(const std::string &name){
-    std::map<std::string, struct Value>::iterator i = variables.find(name);
-    if(i==variables.end()){
-        struct Value v = {Value::Null};
-        return v;
+    const struct Value *const v = FindVariable(Symbols().Find(name));
+    if(!v){
+        struct Value n = {Value::Null};
+        return n;
     }
     else{
-        return i->second;
+        return *v;
     }
 }
 
+/* The verifier relies on the types of variables, so they are kept */
 struct Error Context::SetVariable(const std::string &name, const struct Value &v){
-    std::map<std::string, struct Value>::iterator i = variables.find(name);
-    if(i==variables.end()){
+    struct Value *const to = FindVariable(Symbols().Find(name));
+    if(!to){
         struct Error e = {false, std::string("Variable ") + name + " does not exist"};
         return e;
     }
-    else{
-        i->second = v;
-        struct Error e = {true};
+    
+    struct Value converted = v;
+    std::string s;
+    struct Error e = {true};
+    switch(to->type){
+        case Value::Null:
+            break;
+        case Value::Boolean:
+            e = ValueToBoolean(v, converted.value.boolean);
+            break;
+        case Value::Integer:
+            e = ValueToInteger(v, converted.value.integer);
+            break;
+        case Value::Floating:
+            e = ValueToFloating(v, converted.value.floating);
+            break;
+        case Value::String:
+            e = ValueToString(v, s);
+            converted.value.string = const_cast<char *>(s.c_str());
+            break;
+        case Value::Array:
+            if(v.type!=Value::Array){
+                e.succeeded = false;
+                e.error = "value is not an array";
+            }
+            break;
+    }
+    
+    if(!e.succeeded){
+        e.error = std::string("Cannot set variable ") + name + ": " + e.error;
         return e;
     }
+    
+    if(to->type!=Value::Null)
+        converted.type = to->type;
+    StoreVariable(GetHeap(), *to, converted);
+    return e;
+}
+
+/* Fields are loaded and stored in place, typed callbacks are called directly,
+    and only plain Accessors go through a Value. */
+static void LoadBinding(const struct Binding &b, void *object, struct Value &v){
+    switch(b.kind){
+        case Binding::Callback:
+            b.bind.accessor(object, v, Get);
+            return;
+        case Binding::Field:
+            {
+                const char *const field = static_cast<const char *>(object) + b.bind.offset;
+                v.type = b.type;
+                if(b.type==Value::Integer)
+                    v.value.integer = *reinterpret_cast<const int64_t *>(field);
+                else if(b.type==Value::Floating)
+                    v.value.floating = *reinterpret_cast<const float *>(field);
+                else
+                    v.value.boolean = *reinterpret_cast<const bool *>(field);
+            }
+            return;
+        case Binding::Typed:
+            v.type = b.type;
+            if(b.type==Value::Integer)
+                v.value.integer = b.bind.integer.get(object);
+            else if(b.type==Value::Floating)
+                v.value.floating = b.bind.floating.get(object);
+            else
+                v.value.boolean = b.bind.boolean.get(object);
+            return;
+    }
+}
+
+static struct Error StoreBinding(const struct Binding &b, void *object, const struct Value &v){
+    struct Error e = {true};
+    switch(b.kind){
+        case Binding::Callback:
+            {
+                struct Value temp = v;
+                b.bind.accessor(object, temp, Set);
+            }
+            break;
+        case Binding::Field:
+            {
+                char *const field = static_cast<char *>(object) + b.bind.offset;
+                if(b.type==Value::Integer)
+                    e = ValueToInteger(v, *reinterpret_cast<int64_t *>(field));
+                else if(b.type==Value::Floating)
+                    e = ValueToFloating(v, *reinterpret_cast<float *>(field));
+                else
+                    e = ValueToBoolean(v, *reinterpret_cast<bool *>(field));
+            }
+            break;
+        case Binding::Typed:
+            if(b.type==Value::Integer && b.bind.integer.set){
+                int64_t n;
+                e = ValueToInteger(v, n);
+                if(e.succeeded) b.bind.integer.set(object, n);
+            }
+            else if(b.type==Value::Floating && b.bind.floating.set){
+                float n;
+                e = ValueToFloating(v, n);
+                if(e.succeeded) b.bind.floating.set(object, n);
+            }
+            else if(b.type==Value::Boolean && b.bind.boolean.set){
+                bool n;
+                e = ValueToBoolean(v, n);
+                if(e.succeeded) b.bind.boolean.set(object, n);
+            }
+            else{
+                e.succeeded = false;
+                e.error = "property is read only";
+            }
+            break;
+    }
+    return e;
 }
 
 struct Value Context::GetProperty(const std::string &name){
-    Accessor a = GetAccessor(name);
+    return GetProperty(Symbols().Find(name));
+}
+
+struct Value Context::GetProperty(uint32_t symbol) const {
+    const struct Binding *const b = properties->Find(symbol);
     struct Value v = {Value::Null};
 
-    if(a) a(object, v, Get);
+    if(b) LoadBinding(*b, object, v);
 
     return v;
 }
 
 struct Error Context::SetProperty(const std::string &name, const struct Value &v){
-    Accessor a = GetAccessor(name);
+    const uint32_t symbol = Symbols().Find(name);
     
-    if(a){
-        struct Value temp = v;
-        a(object, temp, Set);
-        struct Error e = {true};
-        return e;
+    if(properties->Find(symbol)){
+        return SetProperty(symbol, v);
     }
     else{
         struct Error e = {false, std::string("Property ") + name + " does not exist"};
@@ -195,615 +632,1714 @@ struct Error Context::SetProperty(const std::string &name, const struct Value &v
     }
 }
 
-uint32_t Context::VerifyString(const std::string &str){
-    uint32_t i = 0;
-    while((i<string_table.size()) && (string_table[i] != str))
-        i++;
+struct Error Context::SetProperty(uint32_t symbol, const struct Value &v){
+    const struct Binding *const b = properties->Find(symbol);
+    
+    if(b){
+        struct Error e = StoreBinding(*b, object, v);
+        if(!e.succeeded)
+            e.error = std::string("Cannot set property ") + Symbols().Name(symbol) + ": " + e.error;
+        else
+            Changed(symbol);
+        return e;
+    }
+    else{
+        struct Error e = {false, std::string("Property ") + Symbols().Name(symbol) + " does not exist"};
+        return e;
+    }
+}
+
+/* Counts a change to `symbol', once anything watches this Context */
+void Context::Changed(uint32_t symbol){
+    if(!watched)
+        return;
+    if(changes.GetHeap()!=GetHeap()){
+        Utils::FlatTable<uint64_t> moved(changes, GetHeap());
+        changes.Swap(moved);
+    }
+    uint64_t *const n = changes.Find(symbol);
+    if(n)
+        (*n)++;
+    else
+        changes[symbol] = 1;
+}
+
+/* A property read by another Context counts as of the last Publish while this
+    one is published, since its own scripts may be changing `changes' */
+uint64_t Context::ChangeOf(uint32_t symbol, bool property) const {
+    if(property && published){
+        const struct Published *const entry = snapshot.Find(symbol);
+        return entry ? entry->changes : 0;
+    }
+    const uint64_t *const n = changes.Find(symbol);
+    return n ? *n : 0;
+}
+
+void Context::Invalidate(const std::string &name){
+    const uint32_t symbol = Symbols().Find(name);
+    if(symbol)
+        Changed(symbol);
+}
+
+/* Notes that the running script read `symbol' of `owner', which is a property
+    when it belongs to another Context */
+void Context::Watch(const Context &owner, uint32_t symbol, bool property){
+    struct Program &p = *running->script;
+    for(size_t i = 0; i<p.reads.size(); i++){
+        if(p.reads[i].owner==&owner && p.reads[i].symbol==symbol)
+            return;
+    }
+    if(p.reads.size()==Program::MaxReads){
+        p.untracked = true;
+        return;
+    }
+    const struct Program::Read read = {&owner, symbol, owner.ChangeOf(symbol, property), property};
+    p.reads.push_back(read);
+    if(!(property && owner.published))
+        owner.watched = true;
+}
 
-    if(i==string_table.size())
-        string_table.push_back(str);
-    return i;
+/* Whether nothing the last execution of `p' read has changed. A module is
+    read before anything of it, so a module that was removed is never used. */
+bool Context::Unchanged(const struct Program &p) const {
+    if(!p.settled)
+        return false;
+    for(size_t i = 0; i<p.reads.size(); i++){
+        const struct Program::Read &read = p.reads[i];
+        if(read.owner->ChangeOf(read.symbol, read.property)!=read.seen)
+            return false;
+    }
+    return true;
 }
 
-void Context::VerifyAndWriteStringIndex(const std::string &str){
-    Utils::AppendObject<int32_t>(VerifyString(str), token_code);
+/* Values that a reactive script would not tell apart */
+static bool Same(const struct Value &a, const struct Value &b){
+    if(a.type!=b.type)
+        return false;
+    switch(a.type){
+        case Value::Null: return true;
+        case Value::Boolean: return a.value.boolean==b.value.boolean;
+        case Value::Integer: return a.value.integer==b.value.integer;
+        case Value::Floating: return a.value.floating==b.value.floating;
+        case Value::String: return strcmp(a.value.string, b.value.string)==0;
+        case Value::Array:
+            return a.value.array->element==b.value.array->element && a.value.array->length==b.value.array->length &&
+                memcmp(a.value.array->data.integer, b.value.array->data.integer, sizeof(int64_t)*a.value.array->length)==0;
+    }
+    return false;
 }
 
-class Parse {
-    unsigned scope; // This should never be needed outside the parse itself.
-public:
+void Context::Publish(){
+    Heap *const h = GetHeap();
+    if(snapshot.GetHeap()!=h){
+        FreeSnapshot();
+        Utils::FlatTable<struct Published> moved(h);
+        snapshot.Swap(moved);
+    }
     
-    struct Error err;
+    /* Readers of the snapshot leave `watched' alone, so changes are counted
+        from the first Publish */
+    watched = true;
     
-    static bool IsWhitespace(char c){
-        return c==' ' || c=='\t' || c=='\n' || c=='\r';
+    const Utils::FlatTable<struct Binding> &table = *properties;
+    for(uint32_t i = 0; i<table.Capacity(); i++){
+        const uint32_t symbol = table.Slot(i)->key;
+        if(symbol==0)
+            continue;
+        
+        struct Value v = {Value::Null};
+        LoadBinding(table.Slot(i)->value, object, v);
+        if(v.type==Value::String){
+            char *const str = v.value.string;
+            v.value.string = CopyString(h, str);
+            GlobalHeap().Release(str, strlen(str)+1);
+        }
+        else if(v.type==Value::Array){
+            v.value.array = CopyArray(*h, *v.value.array);
+        }
+        
+        struct Published *const previous = snapshot.Find(symbol);
+        if(previous){
+            if(!Same(previous->value, v)){
+                Changed(symbol);
+                previous->changes = ChangeOf(symbol, false);
+            }
+            FreeValue(h, previous->value);
+            previous->value = v;
+        }
+        else{
+            Changed(symbol);
+            const struct Published entry = {v, ChangeOf(symbol, false)};
+            snapshot[symbol] = entry;
+        }
     }
-    
-    static bool IsSyntax(char c){
-        return (c>=35 && c<=47 && c!=46) || (c>=91 && c<=96) || (c>=123 && c<=126) || (c>=58 && c<=64);
+    published = true;
+}
+
+void Context::Unpublish(){
+    published = false;
+    FreeSnapshot();
+}
+
+void Context::FreeSnapshot(){
+    for(uint32_t i = 0; i<snapshot.Capacity(); i++){
+        if(snapshot.Slot(i)->key!=0)
+            FreeValue(snapshot.GetHeap(), snapshot.Slot(i)->value.value);
     }
+    snapshot.Clear();
+}
+
+/* Reads a property of a published Context. Strings and arrays are copied
+    into the arena, as strings from Accessors are. */
+void Context::LoadPublished(const Context &owner, uint32_t symbol, struct Value &v){
+    const struct Published *const entry = owner.snapshot.Find(symbol);
+    if(!entry)
+        return;
+    v = entry->value;
+    if(v.type==Value::String)
+        v.value.string = arena.CopyString(v.value.string, strlen(v.value.string));
+    else if(v.type==Value::Array)
+        v.value.array = CopyArray(arena, *v.value.array);
+}
+
+/* Finishes executing `p' without running it, since it would do the same */
+struct Error Context::Skip(struct Program &p){
+    stats.skipped++;
+    Define(p);
+    const struct Error e = {true};
+    return e;
+}
+
+void Context::Cross(const Context *module, uint32_t symbol, enum Crossing crossing){
+    if(hooked && hooks.module)
+        hooks.module(hooks.user, this, module, Symbols().Name(symbol), crossing);
+}
+
+/* The Profiler times the Binding as the host's, and not the hooks */
+void Context::ObserveLoad(const Context *from, const Context *owner, uint32_t module, uint32_t symbol){
+    if(owner!=from)
+        Cross(owner, symbol, ModuleGet);
+    if(reactive){
+        if(module)
+            Watch(*from, module, false);
+        Watch(*owner, symbol, owner!=from);
+    }
+}
+
+void Context::LoadObserved(const Context *from, const Context *owner, uint32_t module, const struct Binding &b, uint32_t symbol, struct Value &v){
+    ObserveLoad(from, owner, module, symbol);
+    if(hooked && hooks.accessor)
+        hooks.accessor(hooks.user, this, owner, Symbols().Name(symbol), Get);
+    if(profiler)
+        profiler->EnterAccessor();
+    LoadBinding(b, owner->object, v);
+    if(profiler)
+        profiler->LeaveAccessor();
+}
+
+struct Error Context::StoreObserved(const Context *from, Context *owner, uint32_t symbol, const struct Value &v){
+    if(owner!=from)
+        Cross(owner, symbol, ModuleSet);
+    if(hooked && hooks.accessor)
+        hooks.accessor(hooks.user, this, owner, Symbols().Name(symbol), Set);
+    if(profiler)
+        profiler->EnterAccessor();
+    const struct Error err = owner->SetProperty(symbol, v);
+    if(profiler)
+        profiler->LeaveAccessor();
+    return err;
+}
+
+/* Only called with Hooks */
+void Context::Started(){
+    if(hooks.started)
+        hooks.started(hooks.user, this);
+}
+
+struct Error Context::Ended(const struct Error &err, enum Status status){
+    if(hooks.ended)
+        hooks.ended(hooks.user, this, err, status);
+    return err;
+}
+
+/* Strings returned by accessors belong to the caller, so they are moved into
+    the arena along with all other temporaries. */
+static void MoveToArena(Arena &arena, struct Value &v){
+    char *const str = v.value.string;
+    const size_t len = strlen(str);
+    v.value.string = arena.CopyString(str, len);
+    GlobalHeap().Release(str, len+1);
+}
+
+/* Applies op to each element of an array, and either to a number or to the
+    element of another array of the same length at the same index. The result
+    is a new array in the arena, of the same element type as the first. */
+static bool ArrayArithmetic(Arena &arena, uint8_t op, struct Value &first, const struct Value &second,
+    struct Error &err, const char *verb){
     
-    static void SkipWhitespace(std::string::const_iterator &i, const std::string::const_iterator end){
-        while(i!=end && IsWhitespace(*i)) i++;
-    }   
-    
-    static std::string GetIdentifier(std::string::const_iterator &i, const std::string::const_iterator end){
-        SkipWhitespace(i, end);
-        const std::string::const_iterator start = i;
-        while(i!=end && !IsWhitespace(*i) && !IsSyntax(*i)) i++;
-        return std::string(start, i);
+    const struct Array &a = *first.value.array;
+    if(op==Op::Remainder){
+        err.succeeded = false;
+        err.error = std::string("Cannot ") + verb + " array expressions";
+        return false;
     }
     
-    template<typename T, Value::Type To>
-    bool Arithmetic(struct Value &first, const struct Value &second){
-        T t;
-        if(To==Value::Integer){
+    const Op::Code code = static_cast<Op::Code>(op);
+    struct Array *const result = AllocateArray(arena, a.element, a.length);
+    if(second.type!=Value::Array){
+        if(a.element==Array::Integer){
             int64_t n;
-            err = ValueToInteger(second, n);
-            if(!err.succeeded){
+            if(!(err = ValueToInteger(second, n)).succeeded){
                 err.error = std::string("Cannot perform arithmetic: ") + err.error;
                 return false;
             }
-            first.value.integer = t(first.value.integer, (int64_t)n);
+            if(op==Op::Divide && n==0){
+                err.succeeded = false;
+                err.error = "Division by zero";
+                return false;
+            }
+            Utils::Elementwise(code, result->data.integer, a.data.integer, &n, true, a.length);
         }
-        else if(To==Value::Floating){
-            float n;
-            err = ValueToFloating(second, n);
-            if(!err.succeeded){
+        else{
+            double n;
+            if(!(err = ValueToFloating(second, n)).succeeded){
                 err.error = std::string("Cannot perform arithmetic: ") + err.error;
                 return false;
             }
-            first.value.floating = t(first.value.floating, n);
+            Utils::Elementwise(code, result->data.floating, a.data.floating, &n, true, a.length);
         }
-        else{
+        first.value.array = result;
+        return true;
+    }
+    
+    const struct Array &b = *second.value.array;
+    if(b.length!=a.length){
+        char lengths[64];
+        sprintf(lengths, " arrays of lengths %u and %u", a.length, b.length);
+        err.succeeded = false;
+        err.error = std::string("Cannot ") + verb + lengths;
+        return false;
+    }
+    
+    /* The second is converted into the result, which the kernel may read
+        from as it writes */
+    if(a.element==Array::Integer){
+        const int64_t *y = b.data.integer;
+        if(b.element!=Array::Integer){
+            for(uint32_t i = 0; i<a.length; i++)
+                result->data.integer[i] = static_cast<int64_t>(b.data.floating[i]);
+            y = result->data.integer;
+        }
+        if(op==Op::Divide && std::find(y, y+a.length, 0)!=y+a.length){
             err.succeeded = false;
-            err.error = std::string("Invalid arithmetic type");
+            err.error = "Division by zero";
             return false;
         }
-        
-        return true;
+        Utils::Elementwise(code, result->data.integer, a.data.integer, y, false, a.length);
     }
-    
-    template<template<typename> class T>
-    inline bool CastingTypedArithmetic(struct Value &first, const struct Value &second, const char *noun = "arithmetic", const char *verb = "calculate"){
-        switch(first.type){
-            case Value::Null:
-                err.succeeded = false;
-                err.error = "Invalid Null expression in ";
-                err.error += noun;
+    else{
+        const double *y = b.data.floating;
+        if(b.element!=Array::Floating){
+            for(uint32_t i = 0; i<a.length; i++)
+                result->data.floating[i] = static_cast<double>(b.data.integer[i]);
+            y = result->data.floating;
+        }
+        Utils::Elementwise(code, result->data.floating, a.data.floating, y, false, a.length);
+    }
+    first.value.array = result;
+    return true;
+}
+
+/* Applies T to two Values, in the type of the first. Arrays apply `op' to
+    each element instead. */
+template<template<typename> class T>
+static bool Arithmetic(Arena &arena, uint8_t op, struct Value &first, const struct Value &second, struct Error &err,
+    const char *noun, const char *verb){
+    switch(first.type){
+        case Value::Null:
+            err.succeeded = false;
+            err.error = std::string("Invalid Null expression in ") + noun;
             return false;
-            case Value::Boolean:
-                err.succeeded = false;
-                err.error = std::string("Cannot ") + verb + " boolean expressions";
+        case Value::Boolean:
+            err.succeeded = false;
+            err.error = std::string("Cannot ") + verb + " boolean expressions";
             return false;
-            case Value::Integer:
-                Arithmetic<T<int64_t>, Value::Integer>(first, second);
+        case Value::Integer:
+            {
+                int64_t n;
+                if(second.type==Value::Integer)
+                    n = second.value.integer;
+                else if(!(err = ValueToInteger(second, n)).succeeded)
+                    break;
+                first.value.integer = T<int64_t>()(first.value.integer, n);
+            }
             return true;
-            case Value::Floating:
-                Arithmetic<T<float>, Value::Floating>(first, second);
-            return true; 
-            case Value::String:
-                err.succeeded = false;
-                err.error = std::string("Cannot ") + verb + " string expressions";
+        case Value::Floating:
+            {
+                double n;
+                if(second.type==Value::Floating)
+                    n = second.value.floating;
+                else if(!(err = ValueToFloating(second, n)).succeeded)
+                    break;
+                first.value.floating = T<double>()(first.value.floating, n);
+            }
             return true;
-        }
-        return true;
+        case Value::String:
+            err.succeeded = false;
+            err.error = std::string("Cannot ") + verb + " string expressions";
+            return false;
+        case Value::Array:
+            return ArrayArithmetic(arena, op, first, second, err, verb);
     }
     
-    static bool NotIsDecDigit(char c){
-        return !IsDecDigit(c);
+    err.error = std::string("Cannot perform arithmetic: ") + err.error;
+    return false;
+}
+
+/* Integer division by zero would take down the host rather than the script */
+static bool DividesByZero(const struct Value &first, const struct Value &second, struct Error &err){
+    int64_t n;
+    if(first.type==Value::Integer && ValueToInteger(second, n).succeeded && n==0){
+        err.succeeded = false;
+        err.error = "Division by zero";
+        return true;
+    }
+    return false;
+}
+
+static bool Concatenate(Arena &arena, struct Value &first, const struct Value &second, struct Error &err){
+    /* Numbers and booleans are short enough not to allocate */
+    std::string s;
+    const char *append = second.value.string;
+    if(second.type!=Value::String){
+        err = ValueToString(second, s);
+        if(!err.succeeded)
+            return false;
+        append = s.c_str();
     }
     
-    struct Value Factor(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-        
-        SkipWhitespace(i, end);
-        std::string value = GetIdentifier(i, end);
-        
-        struct Value v = {Value::Null};
-        
-        /* If all of value is decimal digits and *i is a '.', then we should append the next identifier */
-        if((*i)=='.' && std::find_if(value.begin(), value.end(), NotIsDecDigit)==value.end() && !IsWhitespace(*(i+1))){
-            value += '.';
-            i++;
-            value+=GetIdentifier(i, end);
-            SkipWhitespace(i, end);
-        }
-        
-        SkipWhitespace(i, end);
-                
-        err.succeeded = true;
-        
-        if(IsDecDigit(value[0])){
-            if(find(value.begin(), value.end(), '.')!=value.end()){
-                v.type = Value::Floating;
-                if(!StrToFloat(value.c_str(), &v.value.floating)){
-                    err.succeeded = false;
-                    err.error = "Invlalid floating point literal \"";
-                    err.error += value + '"';
-                }
-            }
-            else{
-                v.type = Value::Integer;
-                if(!StrToInt64(value.c_str(), &v.value.integer)){
-                    err.succeeded = false;
-                    err.error = "Invlalid integer literal \"";
-                    err.error += value + '"';
-                }
+    const size_t l = strlen(first.value.string), n = strlen(append);
+    first.value.string = static_cast<char *>(arena.Reallocate(first.value.string, l+1, l+n+1));
+    memcpy(first.value.string+l, append, n+1);
+    return true;
+}
+
+static bool ConvertToBoolean(const struct Value &v, bool &c, struct Error &err){
+    err = ValueToBoolean(v, c);
+    return err.succeeded;
+}
+
+/* Conditions are mostly the booleans of comparisons, or integers */
+static inline bool IsTrue(const struct Value &v, bool &c, struct Error &err){
+    if(v.type==Value::Boolean)
+        c = v.value.boolean;
+    else if(v.type==Value::Integer)
+        c = v.value.integer>0;
+    else
+        return ConvertToBoolean(v, c, err);
+    return true;
+}
+
+/* Orders two Values in their mutual type, so numbers compare as numbers and
+    anything compared to a string compares as a string */
+static bool Compare(const struct Value &first, const struct Value &second, int &order, struct Error &err){
+    switch(MutualCast(first, second)){
+        case Value::Null:
+            err.succeeded = false;
+            err.error = "Invalid Null expression in comparison";
+            return false;
+        case Value::Boolean:
+            {
+                bool a, b;
+                if(!(err = ValueToBoolean(first, a)).succeeded || !(err = ValueToBoolean(second, b)).succeeded)
+                    return false;
+                order = static_cast<int>(a)-static_cast<int>(b);
             }
-        }
-        else if(value[0]=='"'){
-            v.type = Value::String;
-            v.value.string = (char *)malloc(value.size());
-            memcpy(v.value.string, value.c_str()+1, value.size()-2);
-            v.value.string[value.size()-1] = 0;
-        }
-        else if(value[0]=='(' && value.size()==1){
-            
-            v = Expression(ctx, i, end);
-            
-            SkipWhitespace(i, end);
-            
-            if(i!=end && (*i)!=')'){
-                err.succeeded = false;
-                err.error = "Expected ')'";
-                return v;
+            return true;
+        case Value::Integer:
+            order = (first.value.integer>second.value.integer)-(first.value.integer<second.value.integer);
+            return true;
+        case Value::Floating:
+            {
+                double a, b;
+                if(!(err = ValueToFloating(first, a)).succeeded || !(err = ValueToFloating(second, b)).succeeded)
+                    return false;
+                order = (a>b)-(a<b);
             }
-            
-            i++;
-            SkipWhitespace(i, end);
-            return v;
-        }
-        else if(value=="true"){
-            v.type = Value::Boolean;
-            v.value.boolean = true;
-        }
-        else if(value=="false"){
-            v.type = Value::Boolean;
-            v.value.boolean = false;
-        }
-        else if(value=="get"){
-            const std::string ident = GetIdentifier(i, end);
-            SkipWhitespace(i, end);
-            
-            if(ident=="local"){
-                const std::string variable_name = GetIdentifier(i, end);
-                SkipWhitespace(i, end);
-                v = ctx->GetVariable(variable_name);
-                if(v.type==Value::Null){
-                    err.succeeded = false;
-                    err.error = "Undefined Variable \"";
-                    err.error += variable_name + '"';
+            return true;
+        case Value::String:
+            {
+                std::string a, b;
+                const char *x = first.value.string, *y = second.value.string;
+                if(first.type!=Value::String){
+                    if(!(err = ValueToString(first, a)).succeeded)
+                        return false;
+                    x = a.c_str();
                 }
-            }
-            else{
-                v = ctx->GetProperty(ident);
-                if(v.type==Value::Null){
-                    err.succeeded = false;
-                    err.error = "Undefined Property \"";
-                    err.error += ident + '"';
+                if(second.type!=Value::String){
+                    if(!(err = ValueToString(second, b)).succeeded)
+                        return false;
+                    y = b.c_str();
                 }
+                order = strcmp(x, y);
             }
-        }
-        else if(value=="from"){
-            const std::string module_name = GetIdentifier(i, end);
-            SkipWhitespace(i, end);
-            
-            Context *module = ctx->GetModule(module_name);
-            if(!module){
-                err.succeeded = false;
-                err.error = "No Such Module \"";
-                err.error +=module_name + '"';
-                return v;
-            }
-            
-            std::string ident = GetIdentifier(i, end);
-            SkipWhitespace(i, end);
-            
-            if(ident=="get"){
-                ident = GetIdentifier(i, end);
-                SkipWhitespace(i, end);
-            }
-            
-            if(ident=="local"){
-                err.succeeded = false;
-                err.error = "Cannot get value \"local\" of remote object";
-                return v;
-            }
-            else{
-                v = module->GetProperty(ident);
-                if(v.type==Value::Null){
-                    err.succeeded = false;
-                    err.error = "Undefined Property \"";
-                    err.error += ident + '"';
-                }
-            }
-        }
-        else if(value=="local"){
-            const std::string ident = GetIdentifier(i, end);
-            SkipWhitespace(i, end);
-            v = ctx->GetVariable(ident);
-            if(v.type==Value::Null){
-                err.succeeded = false;
-                err.error = "Undefined Variable \"";
-                err.error += ident + '"';
-            }
-        }
-        else{
+            return true;
+        case Value::Array:
             err.succeeded = false;
-            err.error = "Expected literal, sub-expression, or access at \"";
-            err.error+=value + '"';
-        }
+            err.error = "Cannot compare array expressions";
+            return false;
+    }
+    return false;
+}
+
+static inline void SetBoolean(struct Value &v, bool c){
+    v.type = Value::Boolean;
+    v.value.boolean = c;
+}
 
-        return v;
+static bool Ordered(uint8_t op, int order){
+    switch(op){
+        case Op::Equal: return order==0;
+        case Op::NotEqual: return order!=0;
+        case Op::Less: return order<0;
+        case Op::LessEqual: return order<=0;
+        case Op::Greater: return order>0;
+        default: return order>=0;
     }
-    
-    struct Value Term(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-    
-        err.succeeded = true;
-        SkipWhitespace(i, end);
-        struct Value first = Factor(ctx, i, end);
-        SkipWhitespace(i, end);
-        
-        if(!err.succeeded) return first;
-        
-        while((*i)=='*' || (*i)=='/' || (*i)=='%'){
-            char w = *i;
-            i++;
-            SkipWhitespace(i, end);
-        
-            struct Value second = Factor(ctx, i, end);
-            if(w=='*'){
-                CastingTypedArithmetic<multiply>(first, second, "multiplication", "multiply");
-            }
-            if(w=='/'){
-                CastingTypedArithmetic<divide>(first, second, "division", "divide");
-            }
-            if(w=='%'){
-                CastingTypedArithmetic<remainder>(first, second, "remainder", "modulus");
-            }
-            
-            if(second.type==Value::String) free(second.value.string);
-            
-        }
-        
-        return first;
+}
+
+/* Scripts may make arrays of up to 16M elements */
+static const int64_t MaxArrayLength = 1<<24;
+
+static bool ToIndex(const struct Value &v, int64_t &n, struct Error &err){
+    if(v.type==Value::Integer)
+        n = v.value.integer;
+    else if(!(err = ValueToInteger(v, n)).succeeded)
+        return false;
+    return true;
+}
+
+/* Where `index' is in `array' */
+static bool ElementOf(const struct Value &array, const struct Value &index, uint32_t &at, struct Error &err){
+    if(array.type!=Value::Array){
+        err.succeeded = false;
+        err.error = "Only arrays can be indexed";
+        return false;
     }
-    
-    static void SkipScope1(std::string::const_iterator &i, const std::string::const_iterator end){
-        unsigned l_scope = 0;
-        
-        do{
-            switch(*i){
-                case '"':
-                    *i++;
-                    while(i!=end && (*i!='"') && (*(i-1)!='\\')){
-                        i++;
-                    }
-                    break;
-                case ':': l_scope++; break;
-                case '.': l_scope--; break;
-            }
-            i++;
-        }while(i!=end && l_scope!=0);
+    int64_t n;
+    if(!ToIndex(index, n, err))
+        return false;
+    if(n<0 || n>=array.value.array->length){
+        /* Printed as a double, which C++98 has a format for */
+        char range[96];
+        sprintf(range, "Index %.0f is out of range of an array of length %u", static_cast<double>(n), array.value.array->length);
+        err.succeeded = false;
+        err.error = range;
+        return false;
+    }
+    at = static_cast<uint32_t>(n);
+    return true;
+}
+
+/* Replaces an array with its element at `index' */
+static bool LoadElement(struct Value &array, const struct Value &index, struct Error &err){
+    uint32_t at;
+    if(!ElementOf(array, index, at, err))
+        return false;
+    const struct Array *const a = array.value.array;
+    if(a->element==Array::Integer)
+        IntegerToValue(array, a->data.integer[at]);
+    else
+        FloatingToValue(array, a->data.floating[at]);
+    return true;
+}
+
+static bool StoreElement(struct Value &array, const struct Value &index, const struct Value &v, struct Error &err){
+    uint32_t at;
+    if(!ElementOf(array, index, at, err))
+        return false;
+    struct Array &a = *array.value.array;
+    if(a.element==Array::Integer){
+        if(v.type==Value::Integer)
+            a.data.integer[at] = v.value.integer;
+        else if(!(err = ValueToInteger(v, a.data.integer[at])).succeeded)
+            return false;
+    }
+    else{
+        if(v.type==Value::Floating)
+            a.data.floating[at] = v.value.floating;
+        else if(!(err = ValueToFloating(v, a.data.floating[at])).succeeded)
+            return false;
     }
+    return true;
+}
+
+/* Replaces a length with a new array of zeros in the arena */
+static bool MakeArray(Arena &arena, uint8_t element, struct Value &length, struct Error &err){
+    int64_t n;
+    if(!ToIndex(length, n, err))
+        return false;
+    if(n<0 || n>MaxArrayLength){
+        char invalid[64];
+        sprintf(invalid, "Invalid array length %.0f", static_cast<double>(n));
+        err.succeeded = false;
+        err.error = invalid;
+        return false;
+    }
+    struct Array *const a = AllocateArray(arena, static_cast<Array::Element>(element), static_cast<uint32_t>(n));
+    memset(a+1, 0, sizeof(int64_t)*a->length);
+    length.type = Value::Array;
+    length.value.array = a;
+    return true;
+}
+
+/* The type of element an array of T holds, and its elements */
+static inline Array::Element ElementType(int64_t){ return Array::Integer; }
+static inline Array::Element ElementType(double){ return Array::Floating; }
+static inline int64_t *Elements(const struct Array &a, int64_t){ return a.data.integer; }
+static inline double *Elements(const struct Array &a, double){ return a.data.floating; }
+
+static inline struct Error ToNumber(const struct Value &v, int64_t &out){ return ValueToInteger(v, out); }
+static inline struct Error ToNumber(const struct Value &v, double &out){ return ValueToFloating(v, out); }
+
+template<typename T>
+static bool Number(const struct Value &v, T &out, struct Error &err){
+    if(!(err = ToNumber(v, out)).succeeded){
+        err.error = std::string("Cannot perform arithmetic: ") + err.error;
+        return false;
+    }
+    return true;
+}
+
+/* An argument after the first of an Intrinsic on an array of T. A number is
+    repeated, and an array must be as long, and is converted in the arena if
+    it holds the other type. */
+template<typename T>
+static bool Operand(Arena &arena, Intrinsic::Code f, const struct Value &v, uint32_t length,
+    T &number, const T *&elements, bool &repeat, struct Error &err){
     
-    static void SkipScope(std::string::const_iterator &i, const std::string::const_iterator end){
-        while(i!=end && (*i)!='.'){
-            if((*i)=='"'){
-                i++;
-                while(i!=end && (*i)!='"')
-                    i++;
-                if(i==end) return;
-            }
-            
-            i++;
-        }
-        
+    repeat = v.type!=Value::Array;
+    if(repeat){
+        elements = &number;
+        return Number(v, number, err);
     }
     
-    void Scope(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-        scope++;
-        while(i!=end && (*i)!= '.'){
-            SkipWhitespace(i, end);
-            Statement(ctx, i, end);
-            SkipWhitespace(i, end);
-            if(i==end){
-                err.succeeded = false;
-                err.error = "Unexpected end of input before end of scope";
-                return;
-            }
-        }
-        /* Move off the '.' */
-        i++;
-        SkipWhitespace(i, end);
+    const struct Array &b = *v.value.array;
+    if(b.length!=length){
+        char lengths[80];
+        sprintf(lengths, "Cannot use arrays of lengths %u and %u in ", length, b.length);
+        err.succeeded = false;
+        err.error = std::string(lengths) + Intrinsic::Name(f);
+        return false;
+    }
+    if(b.element==ElementType(T())){
+        elements = Elements(b, T());
+        return true;
+    }
+    T *const converted = static_cast<T *>(arena.Allocate(sizeof(T)*length));
+    for(uint32_t i = 0; i<length; i++)
+        converted[i] = (b.element==Array::Integer) ? static_cast<T>(b.data.integer[i]) : static_cast<T>(b.data.floating[i]);
+    elements = converted;
+    return true;
+}
 
-// TODO: scoping!
-//        CleanScope(ctx);
-        
-        scope--;
+/* Applies an Intrinsic to each element of `a' into `to', which are `length'
+    long, taking the rest of its arguments from `args' */
+template<typename T>
+static bool ElementwiseIntrinsic(Arena &arena, Intrinsic::Code f, T *to, const T *a, uint32_t length,
+    const struct Value *args, struct Error &err){
+    
+    T number, other;
+    const T *b, *c;
+    bool repeat, again;
+    switch(f){
+        case Intrinsic::Min:
+        case Intrinsic::Max:
+            if(!Operand(arena, f, args[1], length, number, b, repeat, err))
+                return false;
+            Utils::Elementwise(f, to, a, b, repeat, length);
+            return true;
+        case Intrinsic::Clamp:
+            if(!Operand(arena, f, args[1], length, number, b, repeat, err) ||
+                !Operand(arena, f, args[2], length, other, c, again, err))
+                return false;
+            Utils::Elementwise(Intrinsic::Max, to, a, b, repeat, length);
+            Utils::Elementwise(Intrinsic::Min, to, to, c, again, length);
+            return true;
+        case Intrinsic::Lerp:
+            /* a-(a-b)*t, which is a+(b-a)*t with b repeated as the second */
+            if(!Operand(arena, f, args[1], length, number, b, repeat, err) || !Number(args[2], other, err))
+                return false;
+            Utils::Elementwise(Op::Subtract, to, a, b, repeat, length);
+            Utils::Elementwise(Op::Multiply, to, to, &other, true, length);
+            Utils::Elementwise(Op::Subtract, to, a, to, false, length);
+            return true;
+        default:
+            Utils::Elementwise(f, to, a, length);
+            return true;
+    }
+}
 
+/* Min, Max, and Clamp of a number, in its own type */
+template<typename T>
+static bool Bound(Intrinsic::Code f, T &x, const struct Value *args, struct Error &err){
+    T lo, hi;
+    if(!Number(args[1], lo, err))
+        return false;
+    if(f==Intrinsic::Min){
+        x = x<lo ? x : lo;
+        return true;
     }
-    
-    void If(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-        SkipWhitespace(i, end);
-        
-        const std::string::const_iterator i_1 = i;
-        
-        struct Value v = Expression(ctx, i, end);
-        
-        const std::string conditional(i_1, i);
-        
-        if(!err.succeeded) return;
-        
-        bool c;
-        struct Error e = ValueToBoolean(v, c);
-        
-        if(!e.succeeded){
-            err = e;
-        }
-        else{
-            err.succeeded = true;
-            SkipWhitespace(i, end);
-            if(*i!=':'){
-                err.succeeded = false;
-                err.error = "Expected ':' after ";
-                err.error += conditional;
-                return;
+    x = x>lo ? x : lo;
+    if(f==Intrinsic::Clamp){
+        if(!Number(args[2], hi, err))
+            return false;
+        x = x<hi ? x : hi;
+    }
+    return true;
+}
+
+/* Applies an Intrinsic to `args', leaving the result in place of the first.
+    Numbers stay in the type of the first, unless the Intrinsic only makes
+    sense in floating point, and arrays give a new array in the arena. */
+static bool CallIntrinsic(Arena &arena, uint8_t code, struct Value *args, struct Error &err){
+    const Intrinsic::Code f = static_cast<Intrinsic::Code>(code);
+    struct Value &first = args[0];
+    switch(first.type){
+        case Value::Null:
+            err.succeeded = false;
+            err.error = std::string("Invalid Null expression in ") + Intrinsic::Name(f);
+            return false;
+        case Value::Boolean:
+        case Value::String:
+            err.succeeded = false;
+            err.error = std::string("Cannot use ") + (first.type==Value::Boolean ? "boolean" : "string") +
+                " expressions in " + Intrinsic::Name(f);
+            return false;
+        case Value::Integer:
+            if(!Intrinsic::Real(f)){
+                int64_t &x = first.value.integer;
+                if(f==Intrinsic::Abs)
+                    x = x<0 ? static_cast<int64_t>(0-static_cast<uint64_t>(x)) : x;
+                else if(f!=Intrinsic::Floor)
+                    return Bound(f, x, args, err);
+                return true;
             }
-            
-            i++;
-            
-            SkipWhitespace(i, end);
-            if(c){
-                Scope(ctx, i, end);
+            FloatingToValue(first, static_cast<double>(first.value.integer));
+            /* FALLTHROUGH */
+        case Value::Floating:
+            {
+                double &x = first.value.floating, b, t;
+                switch(f){
+                    case Intrinsic::Sqrt: x = sqrt(x); return true;
+                    case Intrinsic::Sin: x = sin(x); return true;
+                    case Intrinsic::Cos: x = cos(x); return true;
+                    case Intrinsic::Abs: x = fabs(x); return true;
+                    case Intrinsic::Floor: x = floor(x); return true;
+                    case Intrinsic::Lerp:
+                        if(!Number(args[1], b, err) || !Number(args[2], t, err))
+                            return false;
+                        x = x-(x-b)*t;
+                        return true;
+                    default:
+                        return Bound(f, x, args, err);
+                }
             }
-            else{
-                SkipScope(i, end);
-                if(i==end){
-                    err.succeeded = false;
-                    err.error = "Unexpected end of input before end of scope";
-                    return;
+        case Value::Array:
+            {
+                const struct Array &a = *first.value.array;
+                const Array::Element element = Intrinsic::Real(f) ? Array::Floating : a.element;
+                struct Array *const result = AllocateArray(arena, element, a.length);
+                bool done;
+                if(element==Array::Integer){
+                    done = ElementwiseIntrinsic(arena, f, result->data.integer, a.data.integer, a.length, args, err);
                 }
-                if((*i)!='.'){
-                    err.succeeded = false;
-                    err.error = "Expected '.' at '";
-                    err.error += *i;
-                    err.error += '\'';
-                    return;
+                else{
+                    const double *x = a.data.floating;
+                    if(a.element==Array::Integer){
+                        for(uint32_t i = 0; i<a.length; i++)
+                            result->data.floating[i] = static_cast<double>(a.data.integer[i]);
+                        x = result->data.floating;
+                    }
+                    done = ElementwiseIntrinsic(arena, f, result->data.floating, x, a.length, args, err);
                 }
-                
-                /* Move off the '.' */
-                i++;
+                first.value.array = result;
+                return done;
             }
-        }
     }
+    return false;
+}
+
+static struct Error UndefinedProperty(uint32_t symbol){
+    const struct Error e = {false, std::string("Undefined Property \"") + Symbols().Name(symbol) + '"'};
+    return e;
+}
+
+static struct Error CannotSuspend(){
+    const struct Error e = {false, "Cannot suspend an execution started by an Accessor, or while another is suspended"};
+    return e;
+}
+
+static struct Error NoSuchModule(uint32_t symbol){
+    const struct Error e = {false, std::string("No Such Module \"") + Symbols().Name(symbol) + '"'};
+    return e;
+}
+
+static struct Error UndefinedProcedure(uint32_t symbol){
+    const struct Error e = {false, std::string("Undefined Procedure \"") + Symbols().Name(symbol) + '"'};
+    return e;
+}
+
+static struct Error WrongArguments(const struct Procedure &p, uint32_t arguments){
+    char counts[48];
+    sprintf(counts, " takes %u arguments, not %u", p.arguments, arguments);
+    const struct Error e = {false, std::string("Procedure ") + Symbols().Name(p.symbol) + counts};
+    return e;
+}
+
+/* Frames live in the arena, so recursion is only limited to stop runaways */
+static const unsigned MaxCallDepth = 1024;
+
+/* A cache of the Stable properties of `p', none of which have been read */
+static struct Value *NewCache(Arena &arena, const struct Program &p){
+    if(p.cached.empty())
+        return NULL;
+    struct Value *const cache = static_cast<struct Value *>(arena.Allocate(sizeof(struct Value)*p.cached.size()));
+    for(size_t i = 0; i<p.cached.size(); i++)
+        cache[i].type = Value::Null;
+    return cache;
+}
+
+/* Stable properties may have changed while the execution was suspended */
+static void Forget(struct Value *cache, const struct Program &p){
+    for(size_t i = 0; i<p.cached.size(); i++)
+        cache[i].type = Value::Null;
+}
+
+static void Forget(struct Execution &e){
+    Forget(e.cache, *e.program);
+    for(const struct Frame *f = e.caller; f; f = f->caller)
+        Forget(f->cache, *f->program);
+}
+
+/* Pushes a frame for `p', moving its arguments off the caller's stack into its
+    first slots. The frame and its slots are temporaries of the calling
+    statement. */
+static bool Enter(Arena &arena, Heap *heap, struct Execution &e, const struct Procedure &p,
+    Context *context, struct Error &err){
     
-    void Loop(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-        /* This is a bit of a hack... */
-        SkipWhitespace(i, end);
-        const std::string::const_iterator conditional_start = i;
-        struct Value v = Expression(ctx, i, end);
-        const std::string::const_iterator conditional_end  = i;
-        const std::string conditional(conditional_start, conditional_end);
-        
-        SkipWhitespace(i, end);
-        
-        if((*i)!=':'){
-            err.succeeded = false;
-            err.error = "Expected ':' after ";
-            err.error += conditional;
-            return;
-        }
-        
-        i++;
+    if(e.depth==MaxCallDepth){
+        err.succeeded = false;
+        err.error = "Too many nested procedure calls";
+        return false;
+    }
+    
+    struct Frame *const f = static_cast<struct Frame *>(arena.Allocate(sizeof(struct Frame)));
+    f->program = e.program;
+    f->context = e.context;
+    f->pc = e.pc;
+    f->slots = e.slots;
+    f->top = e.top - p.arguments;
+    f->slot_count = e.slot_count;
+    f->cache = e.cache;
+    f->statement = e.statement;
+    f->procedure = e.procedure;
+    f->caller = e.caller;
+    
+    struct Value *const slots = static_cast<struct Value *>(arena.Allocate(sizeof(struct Value)*(p.slots+p.stack)));
+    for(uint32_t i = 0; i<p.slots; i++)
+        slots[i].type = Value::Null;
+    for(uint32_t i = 0; i<p.arguments; i++)
+        StoreVariable(heap, slots[i], f->top[i]);
+    
+    /* A procedure of the same Program shares its cache */
+    if(p.code!=e.program)
+        e.cache = NewCache(arena, *p.code);
+    p.code->Retain();
+    e.program = p.code;
+    e.context = context;
+    e.pc = p.entry;
+    e.slots = slots;
+    e.top = slots+p.slots;
+    e.slot_count = p.slots;
+    e.statement = arena.GetMark();
+    e.procedure = &p;
+    e.caller = f;
+    e.depth++;
+    return true;
+}
 
-        SkipWhitespace(i, end);
+/* Pops the current frame, returning to the caller */
+static void Leave(Heap *heap, struct Execution &e){
+    const struct Frame *const f = e.caller;
+    FreeVariables(e.slots, e.slot_count, heap);
+    e.program->Release();
+    
+    e.program = f->program;
+    e.context = f->context;
+    e.pc = f->pc;
+    e.slots = f->slots;
+    e.top = f->top;
+    e.slot_count = f->slot_count;
+    e.cache = f->cache;
+    e.statement = f->statement;
+    e.procedure = f->procedure;
+    e.caller = f->caller;
+    e.depth--;
+}
 
-        const std::string::const_iterator scope_start  = i;        
-        bool c;
-        err = ValueToBoolean(v, c);
-        if(!err.succeeded)
-            return;
-        
-        while(c){
-            i = scope_start;
-            Scope(ctx, i, end);
-            i = conditional_start;
-            v = Expression(ctx, i, conditional_end);
-            i = scope_start;
-            err = ValueToBoolean(v, c);
-            if(!err.succeeded)
-                return;
-        }
+static const char *StringTable(const struct Program &p){
+    return p.string_table.empty() ? NULL : &p.string_table.front();
+}
+
+struct Error Context::Run(struct Execution &e, uint64_t budget, enum Status &status){
+    /* These are those of the current frame */
+    const uint8_t *code = &e.program->token_code.front();
+    const char *strings = StringTable(*e.program);
+    struct Value *slots = e.slots;
+    struct Value *top = e.top;
+    uint64_t pc = e.pc;
+    Heap *const heap = GetHeap();
+    
+    struct Error err = {true};
+    status = Finished;
+    
+    e.previous = running;
+    running = &e;
+    
+    /* A profiler takes the budget in slices that end where it next samples,
+        which may be in a later run */
+    Profiler *const profiler = this->profiler;
+    uint64_t reserve = 0;
+    
+    /* Counted here, and added to the stats at the end */
+    const uint64_t given = budget;
+    uint64_t accessors = 0, crossings = 0;
+    const bool observed = hooked || profiler || reactive;
+    Profiler::Outer outer = {0};
+    if(profiler){
+        outer = profiler->Start();
+        reserve = budget;
+        budget = profiler->Slice(reserve);
+        reserve-=budget;
     }
     
-    struct Value Expression(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-        err.succeeded = true;
-        struct Value first = Term(ctx, i, end);
-        
-        if(!err.succeeded) return first;
-                
-        SkipWhitespace(i, end);
-        
-        while((*i)=='-' || (*i)=='+'){
-        
-            char w = *i;
-            i++;
-            SkipWhitespace(i, end);
+    for(;;){
+        if(budget==0){
+            if(reserve==0){
+                status = Suspended;
+                break;
+            }
+            profiler->Sample(e, pc);
+            budget = profiler->Slice(reserve);
+            reserve-=budget;
+        }
+        budget--;
         
-            struct Value second = Term(ctx, i, end);
-            if(w=='+'){
-                if(first.type==Value::String){
-                    std::string s;
-                    err = ValueToString(second, s);
-
-                    if(err.succeeded){
-                        const uint64_t l = strlen(first.value.string);
-                        first.value.string = (char *)realloc(first.value.string, (size_t)(l+s.size()+1));
-                        memcpy(first.value.string+l, s.c_str(), s.size()+1);
+        switch(code[pc++]){
+            case Op::Null:
+                top->type = Value::Null;
+                top++;
+                continue;
+            case Op::Integer:
+                top->type = Value::Integer;
+                top->value.integer = Utils::GetObject<int64_t>(code, pc);
+                top++;
+                continue;
+            case Op::Floating:
+                top->type = Value::Floating;
+                top->value.floating = Utils::GetObject<double>(code, pc);
+                top++;
+                continue;
+            case Op::Boolean:
+                top->type = Value::Boolean;
+                top->value.boolean = Utils::GetObject<uint8_t>(code, pc)!=0;
+                top++;
+                continue;
+            case Op::String:
+                /* Concatenation never writes to its operands, so constants
+                    are not copied. */
+                top->type = Value::String;
+                top->value.string = const_cast<char *>(strings+Utils::GetObject<uint32_t>(code, pc));
+                top++;
+                continue;
+            case Op::Load:
+                *top = slots[Utils::GetObject<uint32_t>(code, pc)];
+                top++;
+                continue;
+            case Op::Store:
+                top--;
+                StoreVariable(heap, slots[Utils::GetObject<uint32_t>(code, pc)], *top);
+                continue;
+            case Op::Declare:
+                {
+                    struct Value &to = slots[Utils::GetObject<uint32_t>(code, pc)];
+                    top--;
+                    to.type = Value::Integer;
+                    if(top->type==Value::Integer)
+                        to.value.integer = top->value.integer;
+                    else if(!(err = ValueToInteger(*top, to.value.integer)).succeeded)
+                        break;
+                }
+                continue;
+            case Op::DeclareInteger:
+                top--;
+                slots[Utils::GetObject<uint32_t>(code, pc)] = *top;
+                continue;
+            case Op::Clear:
+                {
+                    const uint32_t slot = Utils::GetObject<uint32_t>(code, pc);
+                    FreeVariables(slots+slot, Utils::GetObject<uint32_t>(code, pc), heap);
+                }
+                continue;
+            case Op::Detach:
+                if(top[-1].type==Value::String)
+                    top[-1].value.string = arena.CopyString(top[-1].value.string, strlen(top[-1].value.string));
+                else if(top[-1].type==Value::Array)
+                    top[-1].value.array = CopyArray(arena, *top[-1].value.array);
+                continue;
+            case Op::Drop:
+                top--;
+                continue;
+            case Op::GetProperty:
+                {
+                    const uint32_t symbol = Utils::GetObject<uint32_t>(code, pc);
+                    const struct Binding *const b = e.context->properties->Find(symbol);
+                    top->type = Value::Null;
+                    e.pc = pc;
+                    if(b){
+                        accessors++;
+                        if(observed)
+                            LoadObserved(e.context, e.context, 0, *b, symbol, *top);
+                        else
+                            LoadBinding(*b, e.context->object, *top);
                     }
+                    if(top->type==Value::Null){
+                        err = UndefinedProperty(symbol);
+                        break;
+                    }
+                    if(top->type==Value::String)
+                        MoveToArena(arena, *top);
+                    top++;
                 }
-                else{
-                    CastingTypedArithmetic<plus>(first, second, "addition", "add");
+                continue;
+            case Op::SetProperty:
+                {
+                    const uint32_t symbol = Utils::GetObject<uint32_t>(code, pc);
+                    top--;
+                    e.pc = pc;
+                    accessors++;
+                    if(observed)
+                        err = StoreObserved(e.context, e.context, symbol, *top);
+                    else
+                        err = e.context->SetProperty(symbol, *top);
+                    if(!err.succeeded)
+                        break;
                 }
-            }
-            else if(w=='-'){
-                CastingTypedArithmetic<minus>(first, second, "subtraction", "subtract");
-            }
-
-            if(second.type==Value::String) free(second.value.string);
-            
-            if(!err.succeeded) 
-                break;
-            else        
-                SkipWhitespace(i, end);
-            
-        }
-        
-        SkipWhitespace(i, end);
-        return first;
-    }
-
-    struct Value Int(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-        SkipWhitespace(i, end);
-        const std::string name = GetIdentifier(i, end);
-        SkipWhitespace(i, end);
-        
-        struct Value v = {Value::Null};
-        
-        if(i!=end){
-            v = Expression(ctx, i, end);
-            if(err.succeeded){
-                struct Value new_value = {Value::Integer};
-                struct Error e = ValueToInteger(v, new_value.value.integer);
-                if(!e.succeeded){
-                    err = e;
+                continue;
+            case Op::GetModuleProperty:
+                {
+                    const uint32_t module_symbol = Utils::GetObject<uint32_t>(code, pc);
+                    const uint32_t symbol = Utils::GetObject<uint32_t>(code, pc);
+                    const Context *const module = e.context->GetModule(module_symbol);
+                    if(!module){
+                        err = NoSuchModule(module_symbol);
+                        break;
+                    }
+                    top->type = Value::Null;
+                    e.pc = pc;
+                    crossings++;
+                    if(module->published){
+                        if(observed)
+                            ObserveLoad(e.context, module, module_symbol, symbol);
+                        LoadPublished(*module, symbol, *top);
+                    }
+                    else if(const struct Binding *const b = module->properties->Find(symbol)){
+                        accessors++;
+                        if(observed)
+                            LoadObserved(e.context, module, module_symbol, *b, symbol, *top);
+                        else
+                            LoadBinding(*b, module->object, *top);
+                        if(top->type==Value::String)
+                            MoveToArena(arena, *top);
+                    }
+                    if(top->type==Value::Null){
+                        err = UndefinedProperty(symbol);
+                        break;
+                    }
+                    top++;
                 }
-                else{
-// TODO: Scoping
-                    err = ctx->AddVariable(name, new_value);
-//                    if(err.succeeded)
-//                        printf("Created integer variable %s with value %i\n", name.c_str(), (int)new_value.value.integer);
+                continue;
+            case Op::SetModuleProperty:
+                {
+                    const uint32_t module_symbol = Utils::GetObject<uint32_t>(code, pc);
+                    const uint32_t symbol = Utils::GetObject<uint32_t>(code, pc);
+                    Context *const module = e.context->GetModule(module_symbol);
+                    if(!module){
+                        err = NoSuchModule(module_symbol);
+                        break;
+                    }
+                    top--;
+                    e.pc = pc;
+                    crossings++;
+                    accessors++;
+                    if(observed)
+                        err = StoreObserved(e.context, module, symbol, *top);
+                    else
+                        err = module->SetProperty(symbol, *top);
+                    if(!err.succeeded)
+                        break;
+                }
+                continue;
+            case Op::GetCached:
+                {
+                    const uint32_t index = Utils::GetObject<uint32_t>(code, pc);
+                    if(e.cache[index].type!=Value::Null){
+                        *top++ = e.cache[index];
+                        continue;
+                    }
+                    const struct Program::Cached &cached = e.program->cached[index];
+                    const Context *const module = cached.module ? e.context->GetModule(cached.module) : e.context;
+                    if(!module){
+                        err = NoSuchModule(cached.module);
+                        break;
+                    }
+                    top->type = Value::Null;
+                    e.pc = pc;
+                    if(cached.module)
+                        crossings++;
+                    if(cached.module && module->published){
+                        if(observed)
+                            ObserveLoad(e.context, module, cached.module, cached.symbol);
+                        LoadPublished(*module, cached.symbol, *top);
+                    }
+                    else if(const struct Binding *const b = module->properties->Find(cached.symbol)){
+                        accessors++;
+                        if(observed)
+                            LoadObserved(e.context, module, cached.module, *b, cached.symbol, *top);
+                        else
+                            LoadBinding(*b, module->object, *top);
+                        if(top->type==Value::String)
+                            MoveToArena(arena, *top);
+                    }
+                    if(top->type==Value::Null){
+                        err = UndefinedProperty(cached.symbol);
+                        break;
+                    }
+                    /* Strings and arrays would not outlive the statement, so
+                        they are read every time */
+                    if(top->type!=Value::String && top->type!=Value::Array)
+                        e.cache[index] = *top;
+                    top++;
+                }
+                continue;
+            case Op::SetCached:
+                {
+                    const uint32_t index = Utils::GetObject<uint32_t>(code, pc);
+                    const struct Program::Cached &cached = e.program->cached[index];
+                    Context *const module = cached.module ? e.context->GetModule(cached.module) : e.context;
+                    if(!module){
+                        err = NoSuchModule(cached.module);
+                        break;
+                    }
+                    top--;
+                    e.pc = pc;
+                    e.cache[index].type = Value::Null;
+                    if(cached.module)
+                        crossings++;
+                    accessors++;
+                    if(observed)
+                        err = StoreObserved(e.context, module, cached.symbol, *top);
+                    else
+                        err = module->SetProperty(cached.symbol, *top);
+                    if(!err.succeeded)
+                        break;
+                }
+                continue;
+            case Op::Index:
+                top--;
+                if(!LoadElement(top[-1], *top, err))
+                    break;
+                continue;
+            case Op::StoreElement:
+                top-=2;
+                if(!StoreElement(slots[Utils::GetObject<uint32_t>(code, pc)], top[0], top[1], err))
+                    break;
+                continue;
+            case Op::Length:
+                if(top[-1].type!=Value::Array){
+                    err.succeeded = false;
+                    err.error = "Only arrays have a length";
+                    break;
+                }
+                IntegerToValue(top[-1], top[-1].value.array->length);
+                continue;
+            case Op::NewArray:
+                {
+                    const uint8_t element = Utils::GetObject<uint8_t>(code, pc);
+                    if(!MakeArray(arena, element, top[-1], err))
+                        break;
+                }
+                continue;
+            case Op::Intrinsic:
+                {
+                    const uint8_t f = Utils::GetObject<uint8_t>(code, pc);
+                    top-=Intrinsic::Arguments(static_cast<Intrinsic::Code>(f))-1;
+                    if(!CallIntrinsic(arena, f, top-1, err))
+                        break;
+                }
+                continue;
+            case Op::Add:
+                top--;
+                if(top[-1].type==Value::Integer && top->type==Value::Integer){
+                    top[-1].value.integer = plus<int64_t>()(top[-1].value.integer, top->value.integer);
+                    continue;
+                }
+                if(top[-1].type==Value::String){
+                    if(!Concatenate(arena, top[-1], *top, err))
+                        break;
+                    continue;
+                }
+                if(!Arithmetic<plus>(arena, Op::Add, top[-1], *top, err, "addition", "add"))
+                    break;
+                continue;
+            case Op::Subtract:
+                top--;
+                if(!Arithmetic<minus>(arena, Op::Subtract, top[-1], *top, err, "subtraction", "subtract"))
+                    break;
+                continue;
+            case Op::Multiply:
+                top--;
+                if(!Arithmetic<multiply>(arena, Op::Multiply, top[-1], *top, err, "multiplication", "multiply"))
+                    break;
+                continue;
+            case Op::Divide:
+                top--;
+                if(DividesByZero(top[-1], *top, err) || !Arithmetic<divide>(arena, Op::Divide, top[-1], *top, err, "division", "divide"))
+                    break;
+                continue;
+            case Op::Remainder:
+                top--;
+                if(DividesByZero(top[-1], *top, err) || !Arithmetic<remainder>(arena, Op::Remainder, top[-1], *top, err, "remainder", "modulus"))
+                    break;
+                continue;
+            /* Verified to be of the same type, so nothing is checked */
+            case Op::AddInteger:
+                top--;
+                top[-1].value.integer = plus<int64_t>()(top[-1].value.integer, top->value.integer);
+                continue;
+            case Op::SubtractInteger:
+                top--;
+                top[-1].value.integer = minus<int64_t>()(top[-1].value.integer, top->value.integer);
+                continue;
+            case Op::MultiplyInteger:
+                top--;
+                top[-1].value.integer = multiply<int64_t>()(top[-1].value.integer, top->value.integer);
+                continue;
+            case Op::DivideInteger:
+            case Op::RemainderInteger:
+                top--;
+                if(top->value.integer==0){
+                    err.succeeded = false;
+                    err.error = "Division by zero";
+                    break;
+                }
+                if(code[pc-1]==Op::DivideInteger)
+                    top[-1].value.integer = divide<int64_t>()(top[-1].value.integer, top->value.integer);
+                else
+                    top[-1].value.integer = remainder<int64_t>()(top[-1].value.integer, top->value.integer);
+                continue;
+            case Op::AddFloating:
+                top--;
+                top[-1].value.floating+=top->value.floating;
+                continue;
+            case Op::SubtractFloating:
+                top--;
+                top[-1].value.floating-=top->value.floating;
+                continue;
+            case Op::MultiplyFloating:
+                top--;
+                top[-1].value.floating*=top->value.floating;
+                continue;
+            case Op::DivideFloating:
+                top--;
+                top[-1].value.floating/=top->value.floating;
+                continue;
+            case Op::RemainderFloating:
+                top--;
+                top[-1].value.floating = fmod(top[-1].value.floating, top->value.floating);
+                continue;
+            case Op::Equal:
+            case Op::NotEqual:
+            case Op::Less:
+            case Op::LessEqual:
+            case Op::Greater:
+            case Op::GreaterEqual:
+                {
+                    int order;
+                    top--;
+                    if(!Compare(top[-1], *top, order, err))
+                        break;
+                    SetBoolean(top[-1], Ordered(code[pc-1], order));
+                }
+                continue;
+            case Op::EqualInteger:
+                top--;
+                SetBoolean(top[-1], top[-1].value.integer==top->value.integer);
+                continue;
+            case Op::NotEqualInteger:
+                top--;
+                SetBoolean(top[-1], top[-1].value.integer!=top->value.integer);
+                continue;
+            case Op::LessInteger:
+                top--;
+                SetBoolean(top[-1], top[-1].value.integer<top->value.integer);
+                continue;
+            case Op::LessEqualInteger:
+                top--;
+                SetBoolean(top[-1], top[-1].value.integer<=top->value.integer);
+                continue;
+            case Op::GreaterInteger:
+                top--;
+                SetBoolean(top[-1], top[-1].value.integer>top->value.integer);
+                continue;
+            case Op::GreaterEqualInteger:
+                top--;
+                SetBoolean(top[-1], top[-1].value.integer>=top->value.integer);
+                continue;
+            case Op::Not:
+                {
+                    bool c;
+                    if(!IsTrue(top[-1], c, err))
+                        break;
+                    SetBoolean(top[-1], !c);
+                }
+                continue;
+            case Op::Jump:
+                pc = Utils::GetObject<uint32_t>(code, pc);
+                continue;
+            case Op::JumpIfFalse:
+                {
+                    const uint32_t to = Utils::GetObject<uint32_t>(code, pc);
+                    bool c;
+                    top--;
+                    if(!IsTrue(*top, c, err))
+                        break;
+                    if(!c)
+                        pc = to;
+                }
+                continue;
+            case Op::JumpIfTrue:
+                {
+                    const uint32_t to = Utils::GetObject<uint32_t>(code, pc);
+                    bool c;
+                    top--;
+                    if(!IsTrue(*top, c, err))
+                        break;
+                    if(c)
+                        pc = to;
+                }
+                continue;
+            case Op::Call:
+            case Op::CallNamed:
+            case Op::CallModule:
+                {
+                    struct Procedure *p;
+                    Context *context = e.context;
+                    if(code[pc-1]==Op::Call){
+                        p = &e.program->token_procedure_table[Utils::GetObject<uint32_t>(code, pc)];
+                    }
+                    else{
+                        uint32_t module_symbol = 0;
+                        if(code[pc-1]==Op::CallModule){
+                            module_symbol = Utils::GetObject<uint32_t>(code, pc);
+                            if(!(context = e.context->GetModule(module_symbol))){
+                                err = NoSuchModule(module_symbol);
+                                break;
+                            }
+                        }
+                        const uint32_t symbol = Utils::GetObject<uint32_t>(code, pc);
+                        const uint32_t arguments = Utils::GetObject<uint32_t>(code, pc);
+                        if(reactive){
+                            if(module_symbol)
+                                Watch(*e.context, module_symbol, false);
+                            Watch(*context, symbol, false);
+                        }
+                        struct Procedure *const *const found = context->token_procedure_table.Find(symbol);
+                        if(!found){
+                            err = UndefinedProcedure(symbol);
+                            break;
+                        }
+                        p = *found;
+                        if(p->arguments!=arguments){
+                            err = WrongArguments(*p, arguments);
+                            break;
+                        }
+                        if(context!=e.context){
+                            crossings++;
+                            if(observed)
+                                Cross(context, symbol, ModuleCall);
+                        }
+                    }
+                    
+                    if(!p->code && !CompileDeferred(*p, *context, err))
+                        break;
                     
+                    e.pc = pc;
+                    e.top = top;
+                    if(!Enter(arena, heap, e, *p, context, err))
+                        break;
+                    code = &e.program->token_code.front();
+                    strings = StringTable(*e.program);
+                    slots = e.slots;
+                    top = e.top;
+                    pc = e.pc;
                 }
-            }
+                continue;
+            case Op::Return:
+                {
+                    /* The result may be in a variable of the frame, or in its
+                        Program, which could go with it */
+                    struct Value result = *--top;
+                    if(result.type==Value::String)
+                        result.value.string = arena.CopyString(result.value.string, strlen(result.value.string));
+                    else if(result.type==Value::Array)
+                        result.value.array = CopyArray(arena, *result.value.array);
+                    
+                    Leave(heap, e);
+                    code = &e.program->token_code.front();
+                    strings = StringTable(*e.program);
+                    slots = e.slots;
+                    top = e.top;
+                    pc = e.pc;
+                    
+                    *top++ = result;
+                }
+                continue;
+            case Op::Release:
+                arena.Release(e.statement);
+                continue;
+            /* Both of these are statements, so nothing is kept in the arena */
+            case Op::Yield:
+                if(!e.suspendable){
+                    err = CannotSuspend();
+                    break;
+                }
+                arena.Release(e.statement);
+                status = Suspended;
+                break;
+            case Op::Wait:
+                {
+                    const uint32_t to = Utils::GetObject<uint32_t>(code, pc);
+                    bool c;
+                    top--;
+                    if(!IsTrue(*top, c, err))
+                        break;
+                    if(c)
+                        continue;
+                    if(!e.suspendable){
+                        err = CannotSuspend();
+                        break;
+                    }
+                    /* Check the condition again when resumed */
+                    pc = to;
+                    arena.Release(e.statement);
+                    status = Suspended;
+                }
+                break;
+            case Op::End:
+                break;
         }
-
-        return v;
+        
+        /* Only the end of the program, suspending, and errors get here */
+        break;
     }
     
-    struct Value Set(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-        SkipWhitespace(i, end);
-        const std::string name = GetIdentifier(i, end);
-        SkipWhitespace(i, end);
-
-        struct Value v = {Value::Null};
-
-        if(name=="local"){
-        
-            SkipWhitespace(i, end);
-            const std::string variable_name = GetIdentifier(i, end);
-            SkipWhitespace(i, end);
-            v = Expression(ctx, i, end);
-            if(err.succeeded){
-                err = ctx->SetVariable(variable_name, v);
-            }
-        }
-        else{
-            
-            v = Expression(ctx, i, end);
-            if(err.succeeded){
-                err = ctx->SetProperty(name, v);
-            }
-        }
-        return v;
+    running = e.previous;
+    e.pc = pc;
+    e.top = top;
+    
+    if(profiler)
+        profiler->Stop(budget, outer);
+    
+    stats.instructions+=given-budget-reserve;
+    stats.accessor_calls+=accessors;
+    stats.module_crossings+=crossings;
+    
+    if(status==Finished){
+        if(reactive)
+            e.script->settled = err.succeeded && !e.script->untracked;
+        Finish(e);
     }
     
-    struct Value To(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-        SkipWhitespace(i, end);
-        const std::string module_name = GetIdentifier(i, end);
-        SkipWhitespace(i, end);
-        
-        struct Value v = {Value::Null};
+    return err;
+}
 
-        Context *module = ctx->GetModule(module_name);
-        if(!module){
-            err.succeeded = false;
-            err.error = "No Such Module \"";
-            err.error +=module_name + '"';
-            return v;
-        }
-        
-        const std::string name = GetIdentifier(i, end);
-        SkipWhitespace(i, end);
-        
-        if(name=="local"){
-            err.succeeded = false;
-            err.error = "Cannot set value \"local\" of remote object";
-            
-        }
-        else{
-            v = Expression(ctx, i, end);
-            if(err.succeeded){
-                err = module->SetProperty(name, v);
-            }
-        }
-        return v;
+void Context::Finish(struct Execution &e){
+    Heap *const h = GetHeap();
+    while(e.caller)
+        Leave(h, e);
+    FreeVariables(e.slots, e.slot_count, h);
+    e.program->Release();
+    arena.Release(e.base);
+}
+
+/* Makes the procedures of `p' callable by name, replacing any of the same name */
+void Context::Define(struct Program &p){
+    if(token_procedure_table.GetHeap()!=GetHeap()){
+        Utils::FlatTable<struct Procedure *> moved(token_procedure_table, GetHeap());
+        token_procedure_table.Swap(moved);
     }
     
-    bool Statement(Context *ctx, std::string::const_iterator &i, const std::string::const_iterator end){
-        SkipWhitespace(i, end);
-        const std::string word = GetIdentifier(i, end);
-        SkipWhitespace(i, end);
-        
-        if(word=="int"){
-            Int(ctx, i, end);
-        }
-        else if(word=="if"){
-            If(ctx, i, end);   
-        }
-        else if(word=="loop"){
-            If(ctx, i, end);   
-        }
-        else if(word=="set"){
-            Set(ctx, i, end);
-        }
-        else if(word=="to"){
-            To(ctx, i, end);
-        }
-        else{
-            err.succeeded = false;
-            err.error = "Expected statement at \"";
-            err.error+= word + '"';
-            return false;
+    for(size_t i = 0; i<p.token_procedure_table.size(); i++){
+        const uint32_t symbol = p.token_procedure_table[i].symbol;
+        struct Procedure *const *const replaced = token_procedure_table.Find(symbol);
+        if(replaced)
+            (*replaced)->program->Release();
+        if(!replaced || *replaced!=&p.token_procedure_table[i])
+            Changed(symbol);
+        p.Retain();
+        token_procedure_table[symbol] = &p.token_procedure_table[i];
+    }
+}
+
+/* Removes the procedures of `p' that are still callable by name */
+void Context::Undefine(struct Program &p){
+    for(size_t i = 0; i<p.token_procedure_table.size(); i++){
+        const uint32_t symbol = p.token_procedure_table[i].symbol;
+        struct Procedure *const *const defined = token_procedure_table.Find(symbol);
+        if(defined && (*defined)->program==&p){
+            token_procedure_table.Erase(symbol);
+            Changed(symbol);
+            p.Release();
         }
-        
-        return true;
     }
+}
 
-};
+/* Checks and shrinks a compiled Program */
+static struct Error Prepare(struct Program &p, const Context &c, Arena &arena){
+    const struct Error err = Verify(p, c, arena);
+    if(err.succeeded)
+        Optimize(p, arena);
+    return err;
+}
 
-struct Error Context::Execute(const std::string &s){
+struct Error Context::Start(const char *source, size_t length, uint64_t budget, enum Status &status){
+    status = Finished;
+    cache.SetHeap(GetHeap());
+    struct Program *const cached = cache.Find(source, length);
+    if(cached && reactive && Unchanged(*cached))
+        return Skip(*cached);
     
-    std::string::const_iterator i = s.begin();
-    const std::string::const_iterator end = s.end();
+    stats.executions++;
+    if(hooked)
+        Started();
     
-    Parse parser;
+    /* All temporaries of an execution are released together at the end. A
+        mark is used rather than a reset in case an accessor re-enters, or
+        another execution is suspended. */
+    arena.SetHeap(GetHeap());
+    const Arena::Mark base = arena.GetMark();
     
-    parser.SkipWhitespace(i, end);
+    if(cached){
+        stats.cache_hits++;
+        return Start(*cached, base, budget, status);
+    }
+    stats.cache_misses++;
     
-    parser.err.succeeded = true;
+    /* The Context's Program is reused, unless an execution or a procedure
+        still has it. Running a script that defines procedures again
+        replaces them, so their references need not keep it. */
+    if(program && program->refs!=1 && program->IsFrom(source, length))
+        Undefine(*program);
+    if(!program || program->refs!=1){
+        if(program)
+            program->Release();
+        program = Program::Create(GetHeap());
+    }
+    struct Program &p = *program;
     
-    while(i!=end && parser.err.succeeded){
-        parser.Statement(this, i, end);
+    struct Error err = Lithium::Compile(source, length, p, *this, arena);
+    if(err.succeeded)
+        err = Prepare(p, *this, arena);
+    if(!err.succeeded)
+        return hooked ? Ended(err, status) : err;
+    cache.Add(p, source, length);
+    return Start(p, base, budget, status);
+}
+
+/* Runs a checked Program from the start, releasing the arena back to `base'
+    once it finishes */
+struct Error Context::Start(struct Program &p, Arena::Mark base, uint64_t budget, enum Status &status){
+    Define(p);
+    if(reactive){
+        p.reads.clear();
+        p.settled = p.untracked = false;
     }
     
-    if(!parser.err.succeeded){
-//        puts(parser.err.error.c_str());
+    struct Execution *const e = static_cast<struct Execution *>(arena.Allocate(sizeof(struct Execution)));
+    p.Retain();
+    e->script = &p;
+    e->program = &p;
+    e->context = this;
+    e->pc = 0;
+    e->slots = static_cast<struct Value *>(arena.Allocate(sizeof(struct Value)*(p.slots+p.stack)));
+    for(uint32_t i = 0; i<p.slots; i++)
+        e->slots[i].type = Value::Null;
+    e->top = e->slots+p.slots;
+    e->slot_count = p.slots;
+    e->cache = NewCache(arena, p);
+    e->base = base;
+    e->statement = arena.GetMark();
+    e->procedure = NULL;
+    e->caller = NULL;
+    e->depth = 0;
+    e->suspendable = !running && !suspended;
+    
+    const struct Error err = Run(*e, budget, status);
+    if(status==Suspended)
+        suspended = e;
+    return hooked ? Ended(err, status) : err;
+}
+
+struct Error Context::Execute(const std::string &s){
+    return Execute(s.data(), s.size());
+}
+
+struct Error Context::Execute(const char *source, size_t length){
+    enum Status status;
+    if(!running && suspended && suspended->script->IsFrom(source, length))
+        return Resume(~(uint64_t)0, status);
+    return Start(source, length, ~(uint64_t)0, status);
+}
+
+struct Error Context::Execute(const std::string &s, uint64_t budget, enum Status &status){
+    return Execute(s.data(), s.size(), budget, status);
+}
+
+struct Error Context::Execute(const char *source, size_t length, uint64_t budget, enum Status &status){
+    status = Finished;
+    if(!running && suspended && suspended->script->IsFrom(source, length))
+        return Resume(budget, status);
+    if(running){
+        const struct Error e = {false, "Cannot execute with a budget from inside an execution"};
+        return e;
+    }
+    if(suspended){
+        const struct Error e = {false, "Context already has a suspended execution of another script"};
+        return e;
+    }
+    return Start(source, length, budget, status);
+}
+
+struct Error Context::Resume(uint64_t budget, enum Status &status){
+    status = Finished;
+    if(running){
+        const struct Error e = {false, "Cannot resume from inside an execution"};
+        return e;
+    }
+    if(!suspended){
+        const struct Error e = {false, "There is no suspended execution to resume"};
+        return e;
     }
     
-    return parser.err;
+    struct Execution *const e = suspended;
+    suspended = NULL;
+    stats.resumes++;
+    if(hooked)
+        Started();
+    Forget(*e);
+    const struct Error err = Run(*e, budget, status);
+    if(status==Suspended)
+        suspended = e;
+    return hooked ? Ended(err, status) : err;
 }
 
+/* Compiles a deferred procedure for the Context it is called in. Its
+    Program belongs to the one that defines it. */
+bool Context::CompileDeferred(struct Procedure &p, const Context &c, struct Error &err){
+    struct Program &owner = *p.program;
+    const uint32_t index = &p-&owner.token_procedure_table.front();
+    struct Program *const code = Program::Create(owner.heap);
+    const Arena::Mark mark = arena.GetMark();
+    err = Lithium::CompileDeferred(owner, index, *code, c, arena);
+    if(err.succeeded)
+        err = Prepare(*code, c, arena);
+    arena.Release(mark);
+    if(!err.succeeded){
+        code->Release();
+        return false;
+    }
+    
+    for(size_t i = 0; i<owner.deferred.size(); i++){
+        if(owner.deferred[i].procedure==index)
+            owner.deferred[i].compiled = code;
+    }
+    const struct Procedure &compiled = code->token_procedure_table.front();
+    p.entry = compiled.entry;
+    p.slots = compiled.slots;
+    p.stack = compiled.stack;
+    p.code = code;
+    return true;
+}
+
+struct Error Context::Compile(const char *source, size_t length, Script &script){
+    arena.SetHeap(GetHeap());
+    struct Program *const p = Program::Create(GetHeap());
+    struct Error err = Lithium::Compile(source, length, *p, *this, arena);
+    if(err.succeeded)
+        err = Prepare(*p, *this, arena);
+    p->context = this;
+    script = err.succeeded ? Script(p) : Script();
+    p->Release();
+    return err;
+}
+
+struct Error Context::Execute(const Script &script){
+    enum Status status;
+    return Start(script, ~(uint64_t)0, status, false);
+}
+
+struct Error Context::Execute(const Script &script, uint64_t budget, enum Status &status){
+    return Start(script, budget, status, true);
+}
+
+/* Executes a Script as its source would be. Only with a budget may it not be
+    started while another script is suspended. */
+struct Error Context::Start(const Script &script, uint64_t budget, enum Status &status, bool budgeted){
+    status = Finished;
+    struct Program *const p = script.program;
+    if(!p || p->context!=this){
+        const struct Error e = {false, "Script was not compiled for this Context"};
+        return e;
+    }
+    if(!running && suspended && suspended->script==p)
+        return Resume(budget, status);
+    if(budgeted && running){
+        const struct Error e = {false, "Cannot execute with a budget from inside an execution"};
+        return e;
+    }
+    if(budgeted && suspended){
+        const struct Error e = {false, "Context already has a suspended execution of another script"};
+        return e;
+    }
+    
+    if(reactive && Unchanged(*p))
+        return Skip(*p);
+    
+    stats.executions++;
+    if(hooked)
+        Started();
+    arena.SetHeap(GetHeap());
+    return Start(*p, arena.GetMark(), budget, status);
+}
+
+void Context::Cancel(){
+    if(suspended){
+        struct Execution *const e = suspended;
+        suspended = NULL;
+        Finish(*e);
+    }
+}
     
 } // namespace WCL
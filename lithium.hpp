@@ -1,20 +1,52 @@
 #pragma once
 #include <string>
 #include <cstring>
+#include <cstddef>
 #include <stdint.h>
 #include <vector>
-#include <map>
+#include "heap.hpp"
+#include "shared_utils.hpp"
+#include "flat_table.hpp"
+#include "symbol_table.hpp"
+#include "arena.hpp"
+#include "program_cache.hpp"
 
 namespace Lithium{
 
+    struct Program;
+    struct Procedure;
+    struct Execution;
+    class Profiler;
+    class Context;
+    class Batch;
+
+    /* A run of integers or of floating point numbers. Arrays made by
+        scripts have their elements directly after the Array. One returned by
+        an Accessor may point anywhere, such as into the host's own objects,
+        and is read in place rather than copied. */
+    struct Array{
+        enum Element {Integer, Floating};
+        Element element;
+        uint32_t length;
+        union{
+            int64_t *integer;
+            double *floating;
+        } data;
+    };
+    
+    /* A type and a single word. Integers, floating point numbers, and
+        booleans are held in the Value itself, so only strings and arrays
+        allocate. Floating point is double precision, since the word has
+        room for it. */
     struct Value{
-        enum Type {Null, Boolean, Integer, Floating, String};
+        enum Type {Null, Boolean, Integer, Floating, String, Array};
         Type type;
         union{
             int64_t integer;
-            float floating;
+            double floating;
             char *string;
             bool boolean;
+            struct Array *array;
         } value;
     };
     
@@ -23,51 +55,255 @@ namespace Lithium{
     
     enum Mode {Set, Get};
     
+    enum Status {Finished, Suspended};
+    
+    /* How often the value of an Accessor may change. A Constant Accessor is
+        read once when a script is compiled. A Stable one is read at most once
+        each time a script is executed or resumed, unless the script sets it. */
+    enum Purity {Volatile, Stable, Constant};
+    
     typedef bool(*Accessor)(void *a, struct Value &v, Mode mode);
     
+    /* Functions a module may offer to scripts as procedures, which calls
+        through `from' compile into instructions of their own rather than
+        calls into the module. Each takes numbers, or an array first. */
+    namespace Intrinsic{
+        enum Code {Sqrt, Sin, Cos, Abs, Min, Max, Floor, Clamp, Lerp};
+    }
+    
+    /* Typed callbacks, for properties that always hold a single type. A NULL
+        setter makes the property read-only. Floating point properties are
+        single precision on the host's side. */
+    typedef int64_t(*IntegerGetter)(void *a);
+    typedef void(*IntegerSetter)(void *a, int64_t in);
+    typedef float(*FloatingGetter)(void *a);
+    typedef void(*FloatingSetter)(void *a, float in);
+    typedef bool(*BooleanGetter)(void *a);
+    typedef void(*BooleanSetter)(void *a, bool in);
+    
+    /* A property is bound either to an Accessor, directly to a field of the
+        object at a fixed offset, or to a pair of typed callbacks. Fields and
+        typed callbacks skip the Value round trip of an Accessor. */
+    struct Binding{
+        enum Kind {Callback, Field, Typed};
+        Kind kind;
+        Value::Type type;
+        /* Only Accessors may be other than Volatile */
+        Purity purity;
+        union{
+            Accessor accessor;
+            size_t offset;
+            struct{ IntegerGetter get; IntegerSetter set; } integer;
+            struct{ FloatingGetter get; FloatingSetter set; } floating;
+            struct{ BooleanGetter get; BooleanSetter set; } boolean;
+        } bind;
+    };
+    
+    /* Maps the C++ types that may be bound with Context::AddField to ICL types. */
+    template<typename T> struct FieldType;
+    template<> struct FieldType<int64_t>{ static const Value::Type type = Value::Integer; };
+    template<> struct FieldType<float>{ static const Value::Type type = Value::Floating; };
+    template<> struct FieldType<bool>{ static const Value::Type type = Value::Boolean; };
+    
     struct Error ValueToInteger(const struct Value &v, int64_t &out);
+    struct Error ValueToFloating(const struct Value &v, double &out);
+    /* Rounds to single precision */
     struct Error ValueToFloating(const struct Value &v, float &out);
     struct Error ValueToString(const struct Value &v, std::string &out);
     struct Error ValueToBoolean(const struct Value &v, bool &out);
 
     void IntegerToValue(struct Value &v, int64_t in);
-    void FloatingToValue(struct Value &v, float in);
+    void FloatingToValue(struct Value &v, double in);
+    /* The string is allocated from the global Heap */
     void StringToValue(struct Value &v, const std::string &in);
     void BooleanToValue(struct Value &v, bool in);
+    /* The Array is not copied, so it must outlive the statement that reads it */
+    void ArrayToValue(struct Value &v, struct Array &in);
 
     struct Error{
         bool succeeded;
         std::string error;
     };
 
+    /* How a script reaches into a module */
+    enum Crossing {ModuleGet, ModuleSet, ModuleCall};
+
+    /* Callbacks for watching what the scripts of a Context do, such as for
+        telemetry. Any may be NULL. `user' is passed back to each, and
+        `context' is the Context whose script is running. */
+    struct Hooks{
+        void (*started)(void *user, Context *context);
+        /* Called when an execution finishes, suspends, or fails */
+        void (*ended)(void *user, Context *context, const struct Error &result, enum Status status);
+        /* Before a property of `owner' is read or set through its Binding */
+        void (*accessor)(void *user, Context *context, const Context *owner, const char *name, enum Mode mode);
+        /* Before a script uses a property or procedure of another Context */
+        void (*module)(void *user, Context *context, const Context *module, const char *name, enum Crossing crossing);
+        void *user;
+    };
+
+    /* What the scripts of a Context have done since it was created, or since
+        the counts were reset. These are kept whether or not there are Hooks. */
+    struct ExecutionStats{
+        /* Scripts started, and suspended executions resumed */
+        uint64_t executions, resumes;
+        uint64_t instructions;
+        /* Properties read or set through their Binding, which does not
+            include Stable ones already read, and uses of other Contexts */
+        uint64_t accessor_calls, module_crossings;
+        /* Allocations from the Context's Heap */
+        uint64_t allocations;
+        /* Scripts executed from source that were found already compiled,
+            and those that were compiled */
+        uint64_t cache_hits, cache_misses;
+        /* Scripts not executed by a reactive Context, since nothing they
+            read had changed */
+        uint64_t skipped;
+    };
+
+    /* A script compiled ahead of time by Context::Compile or a Batch, which
+        only the Context it was compiled for may execute. Copies share the
+        compiled code. A Script may outlive its Context, but can then only
+        be destroyed. */
+    class Script{
+        struct Program *program;
+        
+        explicit Script(struct Program *p);
+        
+        friend class Context;
+        friend class Batch;
+        
+    public:
+        
+        Script();
+        Script(const Script &that);
+        Script &operator=(const Script &that);
+        ~Script();
+        
+        inline bool IsCompiled() const { return program!=NULL; }
+    };
+    
+    /* A Script, or why it could not be compiled */
+    struct CompiledScript{
+        Script script;
+        struct Error error;
+    };
+
     /* A context roughly associates with a single type of object. */
     class Context{
         Context();
         
-        std::vector<uint8_t> token_code;
-        std::map<std::string, uint64_t> token_jump_table;
-        std::map<std::string, uint64_t> token_procedure_table;
-        /* The string table is a list of immutable strings, 
-            such as string constants and variable names */
-        std::vector<std::string> string_table;
-
-        std::map<std::string, struct Value> variables;
-        std::map<std::string, Accessor> accessors;
-        std::map<std::string, Context *> modules;
+        /* These tables are keyed by symbols from Symbols(). They may be shared
+            with a prototype, and are only copied when this Context changes them. */
+        Utils::Shared<Utils::FlatTable<struct Binding> > properties;
+        Utils::Shared<Utils::FlatTable<Context *> > modules;
+        Utils::Shared<Utils::FlatTable<uint8_t> > intrinsics;
         void *object;
         
-        uint32_t VerifyString(const std::string &str);
-        void VerifyAndWriteStringIndex(const std::string &str);
+        /* Everything this Context allocates, created when first needed */
+        Heap *heap;
         
-        struct Error AddVariable(const std::string &name, struct Value &v);
+        /* Temporaries of the current execution */
+        Arena arena;
         
-        inline void AddTok(uint8_t t){ token_code.push_back(t); }
+        /* The last script compiled, kept for reuse. Created when first needed */
+        struct Program *program;
         
-    public:
+        /* Scripts executed recently, so that executing them again from source
+            does not compile them again */
+        ProgramCache cache;
+        
+        /* Procedures defined by scripts run in this Context, by symbol. Each
+            holds a reference to the Program that defined it. */
+        Utils::FlatTable<struct Procedure *> token_procedure_table;
+        
+        /* The innermost execution that is running, and the one suspended */
+        struct Execution *running, *suspended;
+        
+        /* Set only while profiling */
+        Profiler *profiler;
+        
+        struct Hooks hooks;
+        bool hooked;
         
-        friend class Parse;
+        bool lazy;
+        
+        /* Whether executions note what they read, so that they are only
+            executed again once some of it changed */
+        bool reactive;
+        
+        /* How many times each name was changed, counted once some reactive
+            execution has read this Context */
+        mutable bool watched;
+        Utils::FlatTable<uint64_t> changes;
+        
+        /* The properties as last published, which other Contexts read while
+            this one is published, with how many times each had changed then.
+            Readers watch that count, so they never touch `changes' while this
+            Context runs. Strings are allocated from its Heap. */
+        struct Published{
+            struct Value value;
+            uint64_t changes;
+        };
+        bool published;
+        Utils::FlatTable<struct Published> snapshot;
+        
+        /* Allocations are counted from those of the Heap when last reset */
+        struct ExecutionStats stats;
+        uint64_t allocations_before;
+        
+        Heap *GetHeap();
+        
+        /* Contexts are not copyable, see the prototype constructor instead */
+        Context(const Context &);
+        Context &operator=(const Context &);
+        
+        struct Error AddBinding(const std::string &name, const struct Binding &b);
+        
+        friend class Compiler;
+        friend class Verifier;
+        friend class Batch;
+        
+        /* Access by symbol. An unknown name is symbol 0, which is never found. */
+        Context *GetModule(uint32_t symbol) const;
+        struct Value *FindVariable(uint32_t symbol) const;
+        struct Value GetProperty(uint32_t symbol) const;
+        struct Error SetProperty(uint32_t symbol, const struct Value &v);
+        
+        void Define(struct Program &p);
+        void Undefine(struct Program &p);
+        struct Error Start(const char *source, size_t length, uint64_t budget, enum Status &status);
+        struct Error Start(struct Program &p, Arena::Mark base, uint64_t budget, enum Status &status);
+        struct Error Start(const Script &script, uint64_t budget, enum Status &status, bool budgeted);
+        bool CompileDeferred(struct Procedure &p, const Context &c, struct Error &err);
+        
+        void Changed(uint32_t symbol);
+        uint64_t ChangeOf(uint32_t symbol, bool property) const;
+        void Watch(const Context &owner, uint32_t symbol, bool property);
+        bool Unchanged(const struct Program &p) const;
+        struct Error Skip(struct Program &p);
+        struct Error Run(struct Execution &e, uint64_t budget, enum Status &status);
+        void Finish(struct Execution &e);
+        
+        /* Reading and setting properties with Hooks or a Profiler watching */
+        void ObserveLoad(const Context *from, const Context *owner, uint32_t module, uint32_t symbol);
+        void LoadObserved(const Context *from, const Context *owner, uint32_t module, const struct Binding &b, uint32_t symbol, struct Value &v);
+        void LoadPublished(const Context &owner, uint32_t symbol, struct Value &v);
+        void FreeSnapshot();
+        struct Error StoreObserved(const Context *from, Context *owner, uint32_t symbol, const struct Value &v);
+        void Cross(const Context *module, uint32_t symbol, enum Crossing crossing);
+        void Started();
+        struct Error Ended(const struct Error &err, enum Status status);
+        
+    public:
         
         Context(void *obj);
+        
+        /* Creates a Context that shares the properties, modules, and
+            intrinsics of `prototype'. Creating many Contexts for the same
+            type of object from one prototype costs no allocations until an
+            instance adds or changes its own accessors or modules. */
+        Context(void *obj, const Context &prototype);
         ~Context();
         
         struct Error AddModule(const std::string &name, Context *ctx);
@@ -77,18 +313,155 @@ namespace Lithium{
         Context *GetModule(const std::string &name);
         
         /* Accessors only operate on properties */
-        struct Error AddAccessor(const std::string &name, Accessor);
+        struct Error AddAccessor(const std::string &name, Accessor, Purity purity = Volatile);
 
-        struct Error SetAccessor(const std::string &name, Accessor);
+        struct Error SetAccessor(const std::string &name, Accessor, Purity purity = Volatile);
         Accessor GetAccessor(const std::string &name);
+        
+        /* Binds a property directly to a field of the object, `offset' bytes
+            from the start of it (use offsetof). T is int64_t, float, or bool. */
+        template<typename T>
+        struct Error AddField(const std::string &name, size_t offset){
+            struct Binding b;
+            b.kind = Binding::Field;
+            b.type = FieldType<T>::type;
+            b.purity = Volatile;
+            b.bind.offset = offset;
+            return AddBinding(name, b);
+        }
+        
+        struct Error AddProperty(const std::string &name, IntegerGetter get, IntegerSetter set = NULL);
+        struct Error AddProperty(const std::string &name, FloatingGetter get, FloatingSetter set = NULL);
+        struct Error AddProperty(const std::string &name, BooleanGetter get, BooleanSetter set = NULL);
+
+        /* Scripts of Contexts this is a module of call `code' as the
+            procedure `name', such as `from Math call Sqrt 2'. The call is
+            checked and compiled like arithmetic, so it costs no crossing into
+            this Context, and its scripts can not call it themselves. */
+        struct Error AddIntrinsic(const std::string &name, Intrinsic::Code code);
 
+        /* Variables are those of the script that is running or suspended, in
+            the scope it is at, and only of the procedure it is in while it is
+            in one. They keep their own copy of strings and
+            arrays, and the Value returned by GetVariable still belongs to the
+            Context. A variable keeps its type, and SetVariable converts to
+            it. Variables the script never reads are optimized away, and are
+            not found. */
         struct Value GetVariable(const std::string &name);
         struct Error SetVariable(const std::string &name, const struct Value &v);
 
+        /* Strings and arrays passed to a setting Accessor are only valid for
+            the call. Strings returned by a getting Accessor belong to the
+            caller, and arrays to the Accessor. */
         struct Value GetProperty(const std::string &name);
         struct Error SetProperty(const std::string &name, const struct Value &v);
 
+        /* Memory this Context allocates comes from `a' rather than the global
+            allocator. Only later allocations are affected, so set this before
+            adding accessors or modules, and never during an execution or
+            while one is suspended. */
+        void SetAllocator(const struct Allocator &a);
+        
+        /* Memory currently allocated for this Context's tables, variables and
+            temporaries, since the last call to SetAllocator. Tables shared
+            with a prototype count towards whichever Context copied them. */
+        struct MemoryStats GetMemoryStats() const;
+
+        /* Runs a script until it finishes, or until it suspends itself with
+            yield or wait. Scripts are checked before they run, so the
+            properties, modules, and procedures they use must already exist.
+            Executing the same script while it is suspended resumes it.
+            Procedures the script defines stay in this Context for later
+            scripts, and for scripts of Contexts this is a module of. */
         struct Error Execute(const std::string &s);
+        
+        /* The script is read straight from `source', which is only used
+            until this returns, such as a file mapped into memory. It need not
+            be terminated. */
+        struct Error Execute(const char *source, size_t length);
+        
+        /* Runs at most `budget' instructions of a script. If the budget runs
+            out, or the script yields, `status' is Suspended, and Resume
+            continues from the same instruction with the same variables. A
+            Context can only have one suspended execution, and these can not
+            be used from an Accessor called by this Context. Execute without a
+            budget may still be used while suspended, but the script it runs
+            can not yield. */
+        struct Error Execute(const std::string &s, uint64_t budget, enum Status &status);
+        struct Error Execute(const char *source, size_t length, uint64_t budget, enum Status &status);
+        struct Error Resume(uint64_t budget, enum Status &status);
+        
+        /* Compiles and checks a script without running it. Executing the
+            Script later runs it as Execute would have, as long as the
+            properties, modules, and procedures it uses have not been removed
+            or changed type since. */
+        struct Error Compile(const char *source, size_t length, Script &script);
+        struct Error Execute(const Script &script);
+        struct Error Execute(const Script &script, uint64_t budget, enum Status &status);
+        
+        inline bool IsSuspended() const { return suspended!=NULL; }
+        
+        /* Counts what the scripts this Context runs do to `p', until it is
+            set to NULL. The Profiler is not owned by the Context, and may be
+            shared between Contexts of the same thread. Procedures of modules count as part of
+            the script that calls them. */
+        inline void SetProfiler(Profiler *p){ profiler = p; }
+        inline Profiler *GetProfiler() const { return profiler; }
+        
+        /* Calls `h' for what this Context's scripts do from now on, until it
+            is set to NULL. The Hooks are copied. */
+        void SetHooks(const struct Hooks *h);
+        
+        struct ExecutionStats GetExecutionStats() const;
+        void ResetExecutionStats();
+        
+        /* A lazy Context defers compiling the long procedures of the scripts
+            it compiles until they are first called, so that procedures that
+            rarely run cost little to load. A deferred procedure is only
+            checked when it is compiled, and an error in it is reported by
+            the call. */
+        inline void SetLazy(bool l){ lazy = l; }
+        inline bool IsLazy() const { return lazy; }
+        
+        /* How many of the scripts executed most recently from source are kept
+            compiled, 32 at first. Executing one again only checks that its
+            source is the same. The cache is emptied whenever a property or
+            module of this Context is added, removed, or changed, and can be
+            emptied by hand, such as after changing a module's Accessors. */
+        inline void SetCacheCapacity(size_t n){ cache.SetCapacity(n); }
+        inline size_t GetCacheCapacity() const { return cache.Capacity(); }
+        inline void ClearCache(){ cache.Clear(); }
+        
+        /* A reactive Context notes the properties, modules, and procedures
+            each script reads as it runs. Once it has finished, executing the
+            script again does nothing until one of them has changed, such as
+            for scripts that only work out properties from others. Scripts
+            setting properties, and hosts setting them through the Context,
+            change them. Anything else, such as a field the host wrote to or
+            an Accessor's value, must be changed with Invalidate. Scripts are
+            only found again if they are cached or executed as a Script. */
+        inline void SetReactive(bool r){ reactive = r; }
+        inline bool IsReactive() const { return reactive; }
+        void Invalidate(const std::string &name);
+        
+        /* Reads every property into a snapshot, which other Contexts read
+            through `from' instead of calling this one's Accessors until it is
+            published again. This Context's own scripts still use its
+            properties, so they may run on another thread while the others
+            read. Publishing, such as at the end of each frame, must not
+            happen while any other Context is running, and neither may
+            unpublishing. Setting properties with `to' and calling procedures
+            with `from' are not affected. Compiling interns names in Symbols(),
+            which is not thread safe, so scripts run on other threads must be
+            compiled first with Compile and executed as Scripts, without lazy
+            procedures. */
+        void Publish();
+        /* Reads through the properties again */
+        void Unpublish();
+        inline bool IsPublished() const { return published; }
+        
+        /* Discards the suspended execution, if there is one */
+        void Cancel();
     
     };
 
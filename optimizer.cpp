@@ -0,0 +1,456 @@
+#include "optimizer.hpp"
+#include "bytecode_utils.hpp"
+#include <algorithm>
+
+namespace Lithium{
+
+/* Edits a list of the Program's instructions, and then writes the ones that
+    remain back over its code. Instructions are only ever removed or replaced
+    by shorter ones, so the code never grows. */
+class Optimizer{
+    struct Program &program;
+    Arena &arena;
+    uint8_t *const code;
+    const uint32_t size;
+
+    struct Instruction{
+        uint32_t pc;
+        uint8_t op;
+        /* Which frame's code this is in. 0 is the script's, and n is that of
+            procedure n-1. */
+        uint32_t frame;
+        bool removed;
+        /* Whether a jump goes here, or a frame starts here */
+        bool target;
+    };
+    struct Instruction *instructions;
+    uint32_t count;
+
+    /* The instruction at each pc that one starts at, and count at the end */
+    uint32_t *index;
+
+    /* What List found worth looking at, so that the other passes can be
+        skipped when there is nothing for them to do */
+    bool constants, stores, exits, releases;
+
+    template<typename T>
+    T *Allocate(size_t n){
+        return static_cast<T *>(arena.Allocate(sizeof(T)*n));
+    }
+
+    inline uint32_t Operand(const struct Instruction &in) const {
+        uint64_t at = in.pc+1;
+        return Utils::GetObject<uint32_t>(code, at);
+    }
+
+    inline int64_t Constant(const struct Instruction &in) const {
+        uint64_t at = in.pc+1;
+        return Utils::GetObject<int64_t>(code, at);
+    }
+
+    inline uint32_t Find(uint32_t pc) const {
+        return index[pc];
+    }
+
+    static bool IsJump(uint8_t op){
+        return op==Op::Jump || op==Op::JumpIfFalse || op==Op::JumpIfTrue || op==Op::Wait;
+    }
+
+    /* Whether op only pushes a Value, so that it may be removed along with
+        whatever pops it */
+    static bool IsPure(uint8_t op){
+        return op<=Op::Load;
+    }
+
+    /* Whether op may leave anything in the arena */
+    static bool Allocates(uint8_t op){
+        return (op>=Op::GetProperty && op<=Op::Remainder) || (op>=Op::Call && op<=Op::Return) || op==Op::Detach;
+    }
+
+    /* Whether a condition of `in' is known, and what it is */
+    bool Known(const struct Instruction &in, bool &c) const {
+        if(in.op==Op::Integer)
+            c = Constant(in)>0;
+        else if(in.op==Op::Boolean)
+            c = code[in.pc+1]!=0;
+        else
+            return false;
+        return true;
+    }
+
+    bool Fold(uint8_t op, int64_t a, int64_t b, int64_t &out) const {
+        /* Wrap around as the VM does, without overflowing a signed integer */
+        switch(op){
+            case Op::AddInteger: out = static_cast<int64_t>(static_cast<uint64_t>(a)+static_cast<uint64_t>(b)); return true;
+            case Op::SubtractInteger: out = static_cast<int64_t>(static_cast<uint64_t>(a)-static_cast<uint64_t>(b)); return true;
+            case Op::MultiplyInteger: out = static_cast<int64_t>(static_cast<uint64_t>(a)*static_cast<uint64_t>(b)); return true;
+            /* Leave division by zero to fail when it runs */
+            case Op::DivideInteger: if(b<=0) return false; out = a/b; return true;
+            case Op::RemainderInteger: if(b<=0) return false; out = a%b; return true;
+        }
+        return false;
+    }
+
+    static bool Compare(uint8_t op, int64_t a, int64_t b){
+        switch(op){
+            case Op::EqualInteger: return a==b;
+            case Op::NotEqualInteger: return a!=b;
+            case Op::LessInteger: return a<b;
+            case Op::LessEqualInteger: return a<=b;
+            case Op::GreaterInteger: return a>b;
+            default: return a>=b;
+        }
+    }
+
+    /* Whether op takes two integers that may be constants */
+    static bool Foldable(uint8_t op){
+        return (op>=Op::AddInteger && op<=Op::RemainderInteger) ||
+            (op>=Op::EqualInteger && op<=Op::GreaterEqualInteger);
+    }
+
+public:
+
+    Optimizer(struct Program &p, Arena &a)
+      : program(p)
+      , arena(a)
+      , code(&p.token_code.front())
+      , size(p.token_code.size())
+      , instructions(NULL)
+      , count(0)
+      , index(NULL)
+      , constants(false)
+      , stores(false)
+      , exits(false)
+      , releases(false){}
+
+    void List(){
+        /* There can be no more instructions than bytes */
+        instructions = Allocate<struct Instruction>(size);
+        index = Allocate<uint32_t>(size+1);
+
+        for(uint32_t pc = 0; pc<size; count++){
+            struct Instruction &in = instructions[count];
+            index[pc] = count;
+            in.pc = pc;
+            in.op = code[pc];
+            in.frame = 0;
+            in.removed = false;
+            in.target = false;
+            pc += 1+Op::OperandBytes(static_cast<Op::Code>(in.op));
+
+            const uint8_t previous = count>0 ? instructions[count-1].op : Op::End;
+            if(Foldable(in.op))
+                constants |= count>1 && previous==Op::Integer && instructions[count-2].op==Op::Integer;
+            else if((in.op==Op::JumpIfFalse || in.op==Op::JumpIfTrue || in.op==Op::Wait) &&
+                (previous==Op::Integer || previous==Op::Boolean))
+                constants = true;
+            else if(in.op==Op::Store || in.op==Op::Declare || in.op==Op::DeclareInteger)
+                stores = true;
+            else if(in.op==Op::Release)
+                releases = true;
+        }
+        index[size] = count;
+
+        for(size_t i = 0; i<program.targets.size(); i++)
+            instructions[Find(program.targets[i])].target = true;
+
+        /* A procedure's code is skipped over by the jump just before it */
+        for(uint32_t i = 0; i<program.token_procedure_table.size(); i++){
+            if(program.token_procedure_table[i].Deferred())
+                continue;
+            const uint32_t entry = Find(program.token_procedure_table[i].entry);
+            const uint32_t end = Find(Operand(instructions[entry-1]));
+            instructions[entry].target = true;
+            for(uint32_t at = entry; at<end; at++)
+                instructions[at].frame = i+1;
+        }
+
+        /* Only what follows a jump or a return, and is not jumped to, can be
+            unreachable */
+        for(uint32_t i = 1; i<count && !exits; i++){
+            const uint8_t op = instructions[i-1].op;
+            exits = (op==Op::Jump || op==Op::Return || op==Op::End) && !instructions[i].target;
+        }
+    }
+
+    /* Folds arithmetic and comparisons on integer constants, and jumps on
+        constants. Only
+        instructions in the same block are folded, so that nothing jumps into
+        the middle of what is replaced. */
+    void FoldConstants(){
+        uint32_t *const recent = Allocate<uint32_t>(count);
+        uint32_t depth = 0;
+
+        for(uint32_t i = 0; i<count; i++){
+            struct Instruction &in = instructions[i];
+            if(in.target)
+                depth = 0;
+
+            bool c;
+            if(Foldable(in.op) && depth>=2 &&
+                instructions[recent[depth-1]].op==Op::Integer && instructions[recent[depth-2]].op==Op::Integer){
+                struct Instruction &first = instructions[recent[depth-2]], &second = instructions[recent[depth-1]];
+                int64_t result;
+                if(in.op>=Op::EqualInteger){
+                    /* The constant becomes a shorter Boolean in place */
+                    code[first.pc+1] = Compare(in.op, Constant(first), Constant(second));
+                    first.op = Op::Boolean;
+                    second.removed = in.removed = true;
+                    depth--;
+                    continue;
+                }
+                if(Fold(in.op, Constant(first), Constant(second), result)){
+                    uint64_t at = first.pc+1;
+                    Utils::WriteObject<int64_t>(result, code, at);
+                    second.removed = in.removed = true;
+                    depth--;
+                    continue;
+                }
+            }
+            else if((in.op==Op::JumpIfFalse || in.op==Op::JumpIfTrue) && depth>=1 && Known(instructions[recent[depth-1]], c)){
+                instructions[recent[--depth]].removed = true;
+                if(c==(in.op==Op::JumpIfFalse)){
+                    in.removed = true;
+                    continue;
+                }
+                in.op = Op::Jump;
+            }
+            else if(in.op==Op::Wait && depth>=1 && Known(instructions[recent[depth-1]], c) && c){
+                /* Waiting for something that is already true never suspends */
+                instructions[recent[--depth]].removed = in.removed = true;
+                continue;
+            }
+            recent[depth++] = i;
+        }
+    }
+
+    /* Removes stores to slots that are never loaded in the same frame. The
+        Value stored is dropped instead, unless it was simply pushed. */
+    void RemoveDeadStores(){
+        const uint32_t frames = 1+program.token_procedure_table.size();
+        uint32_t *const first = Allocate<uint32_t>(frames+1);
+        first[0] = 0;
+        first[1] = program.slots;
+        for(uint32_t i = 0; i<program.token_procedure_table.size(); i++)
+            first[i+2] = first[i+1]+program.token_procedure_table[i].slots;
+
+        bool *const loaded = Allocate<bool>(first[frames]);
+        std::fill(loaded, loaded+first[frames], false);
+        /* Setting an element reads the array */
+        for(uint32_t i = 0; i<count; i++){
+            if(!instructions[i].removed && (instructions[i].op==Op::Load || instructions[i].op==Op::StoreElement))
+                loaded[first[instructions[i].frame]+Operand(instructions[i])] = true;
+        }
+
+        uint32_t previous = count;
+        for(uint32_t i = 0; i<count; i++){
+            struct Instruction &in = instructions[i];
+            if(in.removed)
+                continue;
+            if(in.target)
+                previous = count;
+
+            if((in.op==Op::Store || in.op==Op::Declare || in.op==Op::DeclareInteger) &&
+                !loaded[first[in.frame]+Operand(in)]){
+                if(previous<count && IsPure(instructions[previous].op)){
+                    instructions[previous].removed = in.removed = true;
+                    previous = count;
+                    continue;
+                }
+                in.op = Op::Drop;
+            }
+            previous = i;
+        }
+
+        /* A variable that is never read can not be found by name either */
+        std::vector<struct Program::Local, Utils::HeapAllocator<struct Program::Local> > &locals = program.locals;
+        size_t kept = 0;
+        for(size_t i = 0; i<locals.size(); i++){
+            const uint32_t at = Find(locals[i].start);
+            const uint32_t frame = (at<count) ? instructions[at].frame : 0;
+            if(loaded[first[frame]+locals[i].slot])
+                locals[kept++] = locals[i];
+        }
+        locals.resize(kept);
+    }
+
+    /* Removes releases of statements that turned out to leave nothing in the
+        arena, such as arithmetic the verifier found was on numbers. Anything
+        jumped into could have come from elsewhere, so only what runs straight
+        through from the last release is looked at. */
+    void RemoveReleases(){
+        bool allocated = false;
+        for(uint32_t i = 0; i<count; i++){
+            const struct Instruction &in = instructions[i];
+            if(in.target)
+                allocated = true;
+            if(in.removed)
+                continue;
+            if(in.op==Op::Release){
+                instructions[i].removed = !allocated;
+                allocated = false;
+            }
+            else if(Allocates(in.op)){
+                allocated = true;
+            }
+        }
+    }
+
+    /* The next instruction that remains, from i on */
+    inline uint32_t Next(uint32_t i) const {
+        while(i<count && instructions[i].removed)
+            i++;
+        return i;
+    }
+
+    /* Removes what can not be reached from the start of the script or of a
+        procedure, and then jumps to where execution would go anyway */
+    void RemoveUnreachable(){
+        bool *const reached = Allocate<bool>(count);
+        std::fill(reached, reached+count, false);
+        uint32_t *const queue = Allocate<uint32_t>(count);
+        uint32_t queued = 0;
+
+        queue[queued++] = 0;
+        reached[0] = count!=0;
+        for(uint32_t i = 0; i<program.token_procedure_table.size(); i++){
+            if(program.token_procedure_table[i].Deferred())
+                continue;
+            const uint32_t entry = Find(program.token_procedure_table[i].entry);
+            reached[entry] = true;
+            queue[queued++] = entry;
+        }
+
+        while(queued){
+            uint32_t i = queue[--queued];
+            while(i<count){
+                const struct Instruction &in = instructions[i];
+                if(!in.removed && IsJump(in.op)){
+                    const uint32_t to = Find(Operand(in));
+                    if(to<count && !reached[to]){
+                        reached[to] = true;
+                        queue[queued++] = to;
+                    }
+                }
+                if(!in.removed && (in.op==Op::Jump || in.op==Op::Return || in.op==Op::End))
+                    break;
+                if(++i<count){
+                    if(reached[i])
+                        break;
+                    reached[i] = true;
+                }
+            }
+        }
+
+        for(uint32_t i = 0; i<count; i++){
+            if(!reached[i])
+                instructions[i].removed = true;
+        }
+
+        /* Backwards, so that jumps to jumps that are removed go too */
+        for(uint32_t i = count; i-->0;){
+            struct Instruction &in = instructions[i];
+            if(!in.removed && in.op==Op::Jump && Next(i+1)==Next(Find(Operand(in))))
+                in.removed = true;
+        }
+    }
+
+    /* Where an instruction that was at pc is now. Anything removed is
+        replaced by the next instruction that remains. */
+    inline uint32_t Relocate(const uint32_t *moved, uint32_t pc) const {
+        return moved[Find(pc)];
+    }
+
+    void Compact(){
+        uint32_t *const moved = Allocate<uint32_t>(count+1);
+        uint32_t to = 0;
+        for(uint32_t i = 0; i<count; i++){
+            moved[i] = to;
+            if(!instructions[i].removed)
+                to += 1+Op::OperandBytes(static_cast<Op::Code>(instructions[i].op));
+        }
+        moved[count] = to;
+
+        if(to==size)
+            return;
+
+        program.targets.clear();
+        program.backwards = false;
+
+        for(uint32_t i = 0; i<count; i++){
+            const struct Instruction &in = instructions[i];
+            if(in.removed)
+                continue;
+
+            uint64_t at = moved[i];
+            const unsigned operands = Op::OperandBytes(static_cast<Op::Code>(in.op));
+            if(IsJump(in.op)){
+                const uint32_t destination = Relocate(moved, Operand(in));
+                code[at++] = in.op;
+                Utils::WriteObject<uint32_t>(destination, code, at);
+                program.targets.push_back(destination);
+                if(destination<at)
+                    program.backwards = true;
+            }
+            else{
+                memmove(code+at+1, code+in.pc+1, operands);
+                code[at] = in.op;
+            }
+        }
+
+        for(uint32_t i = 0; i<program.token_procedure_table.size(); i++){
+            struct Procedure &p = program.token_procedure_table[i];
+            if(!p.Deferred())
+                p.entry = Relocate(moved, p.entry);
+        }
+
+        for(size_t i = 0; i<program.locals.size(); i++){
+            struct Program::Local &local = program.locals[i];
+            local.start = Relocate(moved, local.start);
+            local.end = Relocate(moved, local.end);
+        }
+
+        /* Statements that lost all their code now start where the next one
+            does, which takes their place */
+        size_t kept = 0;
+        for(size_t i = 0; i<program.lines.size(); i++){
+            struct Program::Line line = program.lines[i];
+            line.pc = Relocate(moved, line.pc);
+            if(kept && program.lines[kept-1].pc==line.pc)
+                kept--;
+            program.lines[kept++] = line;
+        }
+        program.lines.resize(kept);
+
+        program.token_code.resize(to);
+    }
+
+    void Run(){
+        if(size==0)
+            return;
+        List();
+        if(!(constants || stores || exits || releases))
+            return;
+        if(constants)
+            FoldConstants();
+        if(stores)
+            RemoveDeadStores();
+        if(releases)
+            RemoveReleases();
+        if(constants || exits)
+            RemoveUnreachable();
+        Compact();
+    }
+
+};
+
+void Optimize(struct Program &program, Arena &arena){
+    const Arena::Mark mark = arena.GetMark();
+
+    Optimizer optimizer(program, arena);
+    optimizer.Run();
+
+    arena.Release(mark);
+}
+
+} // namespace Lithium
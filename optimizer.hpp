@@ -0,0 +1,16 @@
+#pragma once
+#include "lithium.hpp"
+#include "program.hpp"
+#include "arena.hpp"
+
+namespace Lithium{
+
+/* Shrinks a verified Program. Arithmetic on integer constants is folded,
+    branches on constants are resolved, code that can not be reached is
+    removed, and stores to variables that are never read are dropped, along
+    with the variables, as are releases of statements that leave nothing in
+    the arena. Any scratch memory is taken from `arena' and released before
+    returning. */
+void Optimize(struct Program &program, Arena &arena);
+
+}
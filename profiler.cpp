@@ -0,0 +1,290 @@
+#include "profiler.hpp"
+#include "program.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace Lithium{
+
+Profiler::Profiler(uint64_t i, Clock c)
+  : interval(i ? i : 1)
+  , clock(c)
+  , current(NULL)
+  , started(0)
+  , countdown(0)
+  , runs(0)
+  , accessor_nanoseconds(0)
+  , accessor_started(0)
+  , accessor_depth(0)
+  , accessor_calls(0){
+
+}
+
+void Profiler::Clear(){
+    stacks.clear();
+    scripts.clear();
+    script_index.clear();
+    current = NULL;
+    countdown = 0;
+    accessor_nanoseconds = 0;
+    accessor_calls = 0;
+}
+
+/* Counts the time since the last Sample to the stack it was of. A call to
+    the host that is still going counts up to now. */
+void Profiler::Close(){
+    if(!clock)
+        return;
+    const int64_t now = clock();
+    int64_t accessor = accessor_nanoseconds;
+    if(accessor_depth){
+        accessor+=now-accessor_started;
+        accessor_started = now;
+    }
+    const int64_t elapsed = now-started;
+    if(accessor>elapsed)
+        accessor = elapsed;
+    if(current){
+        current->nanoseconds+=elapsed-accessor;
+        current->accessor_nanoseconds+=accessor;
+    }
+    accessor_nanoseconds = 0;
+    started = now;
+}
+
+/* Scripts are named by their first line, without the characters that the
+    folded format gives meaning to */
+uint32_t Profiler::Script(const struct Program &program){
+    std::string name(program.title.begin(), program.title.end());
+    while(!name.empty() && (name[name.size()-1]==' ' || name[name.size()-1]=='\t' || name[name.size()-1]=='\r'))
+        name.erase(name.size()-1);
+    std::replace(name.begin(), name.end(), ';', ',');
+    if(name.empty())
+        name = "(empty)";
+
+    const std::map<std::string, uint32_t>::const_iterator i = script_index.find(name);
+    if(i!=script_index.end())
+        return i->second;
+    script_index[name] = scripts.size();
+    scripts.push_back(name);
+    return scripts.size()-1;
+}
+
+static void AppendNumber(std::string &out, uint64_t n){
+    char digits[24];
+    unsigned i = sizeof(digits);
+    do{
+        digits[--i] = '0'+n%10;
+        n/=10;
+    }while(n);
+    out.append(digits+i, sizeof(digits)-i);
+}
+
+/* The function, which is the script or the procedure, then where in it */
+void Profiler::AppendFrame(const struct Program &program, uint64_t pc, bool procedure, struct Entry &where){
+    where.script = Script(program);
+    if(procedure){
+        const struct Procedure *p = NULL;
+        for(size_t i = 0; i<program.token_procedure_table.size(); i++){
+            const struct Procedure &candidate = program.token_procedure_table[i];
+            if(candidate.entry<=pc && (!p || candidate.entry>p->entry))
+                p = &candidate;
+        }
+        key+=p ? Symbols().Name(p->symbol) : "(procedure)";
+    }
+    else{
+        key+=scripts[where.script];
+    }
+
+    const struct Program::Line *const line = program.FindLine(pc);
+    where.line = line ? line->line : 0;
+    where.column = line ? line->column : 0;
+    key+=';';
+    AppendNumber(key, where.line);
+    key+=':';
+    AppendNumber(key, where.column);
+}
+
+/* Callers first, each at the call they are in the middle of */
+void Profiler::AppendCallers(const struct Frame *f, struct Entry &where){
+    if(!f)
+        return;
+    AppendCallers(f->caller, where);
+    AppendFrame(*f->program, f->pc-1, f->caller!=NULL, where);
+    key+=';';
+}
+
+void Profiler::Sample(const struct Execution &e, uint64_t pc){
+    Close();
+
+    struct Entry where = {0, 0, 0, 0, 0, 0};
+    key.clear();
+    AppendCallers(e.caller, where);
+    AppendFrame(*e.program, pc, e.caller!=NULL, where);
+
+    std::map<std::string, struct Entry>::iterator i = stacks.find(key);
+    if(i==stacks.end())
+        i = stacks.insert(std::make_pair(key, where)).first;
+    current = &i->second;
+    current->instructions+=interval;
+    countdown = interval;
+}
+
+/* The time between executions is the host's, and is not counted */
+struct Profiler::Outer Profiler::Start(){
+    if(runs++)
+        Close();
+    else if(clock)
+        started = clock();
+    const struct Outer outer = {accessor_depth};
+    accessor_depth = 0;
+    return outer;
+}
+
+void Profiler::Stop(uint64_t unused, const struct Outer &outer){
+    Close();
+    countdown+=unused;
+    runs--;
+    accessor_depth = outer.accessor_depth;
+    if(accessor_depth && clock)
+        accessor_started = started;
+}
+
+void Profiler::Folded(std::string &out) const {
+    for(std::map<std::string, struct Entry>::const_iterator i = stacks.begin(); i!=stacks.end(); i++){
+        const struct Entry &entry = i->second;
+        const uint64_t weight = clock ? entry.nanoseconds : entry.instructions;
+        if(weight){
+            out+=i->first;
+            out+=' ';
+            AppendNumber(out, weight);
+            out+='\n';
+        }
+        if(clock && entry.accessor_nanoseconds){
+            out+=i->first;
+            out+=";[accessor] ";
+            AppendNumber(out, entry.accessor_nanoseconds);
+            out+='\n';
+        }
+    }
+}
+
+struct Error Profiler::WriteFolded(const std::string &path) const {
+    std::string folded;
+    Folded(folded);
+
+    struct Error e = {true};
+    FILE *const file = fopen(path.c_str(), "wb");
+    if(!file || fwrite(folded.data(), 1, folded.size(), file)!=folded.size()){
+        e.succeeded = false;
+        e.error = std::string("Could not write ") + path;
+    }
+    if(file && fclose(file)!=0 && e.succeeded){
+        e.succeeded = false;
+        e.error = std::string("Could not write ") + path;
+    }
+    return e;
+}
+
+namespace {
+
+struct Totals{
+    uint64_t instructions;
+    int64_t nanoseconds, accessor_nanoseconds;
+    uint32_t script, line;
+};
+
+/* Hottest first, by time if there is any, then by instructions */
+struct Hotter{
+    bool operator()(const struct Totals &a, const struct Totals &b) const {
+        const int64_t at = a.nanoseconds+a.accessor_nanoseconds, bt = b.nanoseconds+b.accessor_nanoseconds;
+        if(at!=bt)
+            return at>bt;
+        return a.instructions>b.instructions;
+    }
+};
+
+void Add(struct Totals &to, const struct Totals &from){
+    to.instructions+=from.instructions;
+    to.nanoseconds+=from.nanoseconds;
+    to.accessor_nanoseconds+=from.accessor_nanoseconds;
+}
+
+void AppendRow(std::string &out, const struct Totals &t, bool clock, const std::string &name){
+    out+="  ";
+    AppendNumber(out, t.instructions);
+    if(clock){
+        out+="  ";
+        AppendNumber(out, t.nanoseconds);
+        out+="  ";
+        AppendNumber(out, t.accessor_nanoseconds);
+    }
+    if(!name.empty()){
+        out+="  ";
+        out+=name;
+    }
+    out+='\n';
+}
+
+} // namespace
+
+void Profiler::Report(std::string &out, unsigned lines) const {
+    /* Everything is counted where the innermost frame is */
+    std::vector<struct Totals> by_script(scripts.size());
+    std::map<std::pair<uint32_t, uint32_t>, struct Totals> by_line;
+    struct Totals total = {0, 0, 0, 0, 0};
+    for(uint32_t i = 0; i<scripts.size(); i++){
+        const struct Totals none = {0, 0, 0, i, 0};
+        by_script[i] = none;
+    }
+
+    for(std::map<std::string, struct Entry>::const_iterator i = stacks.begin(); i!=stacks.end(); i++){
+        const struct Entry &entry = i->second;
+        const struct Totals t = {entry.instructions, entry.nanoseconds, entry.accessor_nanoseconds,
+            entry.script, entry.line};
+        Add(total, t);
+        Add(by_script[entry.script], t);
+        const std::pair<uint32_t, uint32_t> where(entry.script, entry.line);
+        std::map<std::pair<uint32_t, uint32_t>, struct Totals>::iterator l = by_line.find(where);
+        if(l==by_line.end())
+            by_line[where] = t;
+        else
+            Add(l->second, t);
+    }
+
+    std::vector<struct Totals> hot_lines;
+    for(std::map<std::pair<uint32_t, uint32_t>, struct Totals>::const_iterator i = by_line.begin(); i!=by_line.end(); i++)
+        hot_lines.push_back(i->second);
+    std::stable_sort(by_script.begin(), by_script.end(), Hotter());
+    std::stable_sort(hot_lines.begin(), hot_lines.end(), Hotter());
+    if(hot_lines.size()>lines)
+        hot_lines.resize(lines);
+
+    const char *const columns = clock ? "  instructions  interpreter ns  accessor ns" : "  instructions";
+
+    out+="Scripts\n";
+    out+=columns;
+    out+="  script\n";
+    for(size_t i = 0; i<by_script.size(); i++)
+        AppendRow(out, by_script[i], clock!=NULL, scripts[by_script[i].script]);
+
+    out+="Lines\n";
+    out+=columns;
+    out+="  script:line\n";
+    for(size_t i = 0; i<hot_lines.size(); i++){
+        std::string name = scripts[hot_lines[i].script];
+        name+=':';
+        AppendNumber(name, hot_lines[i].line);
+        AppendRow(out, hot_lines[i], clock!=NULL, name);
+    }
+
+    out+="Total\n";
+    out+=columns;
+    out+='\n';
+    AppendRow(out, total, clock!=NULL, "");
+    out+="  ";
+    AppendNumber(out, accessor_calls);
+    out+=" calls to the host\n";
+}
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "lithium.hpp"
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace Lithium{
+
+struct Program;
+struct Frame;
+struct Execution;
+
+/* Attributes the instructions a Context runs, and the time they take, to the
+    lines and columns of the scripts they came from. Set one on a Context with
+    Context::SetProfiler. Every `interval' instructions the Profiler notes where
+    the script is, and counts the next `interval' instructions there. The count
+    carries on from one execution to the next, so that scripts shorter than the
+    interval are noted throughout. An interval of 1 counts every instruction
+    exactly, which is much slower, and is meant for debug builds. */
+class Profiler{
+public:
+
+    /* Nanoseconds from any fixed point, such as lithium_nanoseconds in the
+        standard library */
+    typedef int64_t (*Clock)();
+
+    /* Without a clock, only instructions are counted */
+    explicit Profiler(uint64_t interval = 1000, Clock clock = NULL);
+
+    inline uint64_t Interval() const { return interval; }
+
+    /* Forgets everything counted so far. Not while a script is running. */
+    void Clear();
+
+    /* One line for each distinct stack: the script, named by its first line,
+        and the line and column in it, then each procedure called and the
+        line and column in it, separated by ';'. Time spent in Accessors and
+        typed callbacks is a further "[accessor]" frame. The weight that ends
+        each line is nanoseconds with a clock, and instructions without.
+        flamegraph.pl and similar tools accept this as it is. */
+    void Folded(std::string &out) const;
+    struct Error WriteFolded(const std::string &path) const;
+
+    /* A summary of the scripts and lines that ran the most instructions or
+        took the most time, and of the time spent in the interpreter against
+        that in Accessors */
+    void Report(std::string &out, unsigned lines = 20) const;
+
+private:
+
+    struct Entry{
+        uint64_t instructions;
+        int64_t nanoseconds, accessor_nanoseconds;
+        /* Where the innermost frame is */
+        uint32_t script, line, column;
+    };
+
+    const uint64_t interval;
+    const Clock clock;
+
+    std::map<std::string, struct Entry> stacks;
+    /* Names of the scripts, by their index in Entry, and the reverse */
+    std::vector<std::string> scripts;
+    std::map<std::string, uint32_t> script_index;
+
+    /* The stack the instructions now running are counted to, and when they
+        started */
+    struct Entry *current;
+    int64_t started;
+
+    /* Instructions until the next Sample that no run has taken yet, and how
+        many runs are going, one inside another */
+    uint64_t countdown;
+    unsigned runs;
+
+    /* Time spent in calls to the host since `started', and when the
+        outermost call still going began */
+    int64_t accessor_nanoseconds;
+    int64_t accessor_started;
+    unsigned accessor_depth;
+    uint64_t accessor_calls;
+
+    std::string key;
+
+    friend class Context;
+
+    /* What an execution started by an Accessor interrupted */
+    struct Outer{
+        unsigned accessor_depth;
+    };
+
+    /* Each run of an execution is between a Start and a Stop */
+    struct Outer Start();
+    /* Takes up to `budget' instructions that run before the next Sample */
+    inline uint64_t Slice(uint64_t budget){
+        if(countdown<budget)
+            budget = countdown;
+        countdown-=budget;
+        return budget;
+    }
+    /* Counts the next `interval' instructions to where `e' is, at pc */
+    void Sample(const struct Execution &e, uint64_t pc);
+    /* `unused' is how many instructions of the last Slice did not run */
+    void Stop(uint64_t unused, const struct Outer &outer);
+
+    inline void EnterAccessor(){
+        if(accessor_depth++==0 && clock)
+            accessor_started = clock();
+        accessor_calls++;
+    }
+    inline void LeaveAccessor(){
+        if(--accessor_depth==0 && clock)
+            accessor_nanoseconds+=clock()-accessor_started;
+    }
+
+    void Close();
+    void AppendFrame(const struct Program &program, uint64_t pc, bool procedure, struct Entry &where);
+    void AppendCallers(const struct Frame *f, struct Entry &where);
+    uint32_t Script(const struct Program &program);
+
+    Profiler(const Profiler &);
+    Profiler &operator=(const Profiler &);
+
+};
+
+}
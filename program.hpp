@@ -0,0 +1,457 @@
+#pragma once
+#include "lithium.hpp"
+#include "arena.hpp"
+#include "flat_table.hpp"
+#include <vector>
+#include <cstring>
+#include <new>
+#include <stdint.h>
+
+namespace Lithium{
+
+/* The instructions of compiled ICL. Each is a single byte, followed by its
+    operands in the order given, which are written and read with the functions
+    in bytecode_utils.hpp. Instructions work on a stack of Values, and on the
+    slots of the frame, which hold variables and arguments. */
+namespace Op{
+    enum Code{
+        Null,               /* Pushes Null */
+        Integer,            /* int64_t value: pushes value */
+        Floating,           /* double value: pushes value */
+        Boolean,            /* uint8_t value: pushes value */
+        String,             /* uint32_t offset: pushes the constant at offset in the string table */
+        Load,               /* uint32_t slot: pushes the variable in slot */
+        Store,              /* uint32_t slot: pops into the variable in slot */
+        Declare,            /* uint32_t slot: pops into slot as an integer */
+        DeclareInteger,     /* uint32_t slot: pops an integer into slot */
+        Clear,              /* uint32_t slot, uint32_t count: destroys count variables from slot */
+        Detach,             /* Copies a string or array on top of the stack into the arena */
+        Drop,               /* Pops */
+        GetProperty,        /* uint32_t symbol: pushes the property */
+        SetProperty,        /* uint32_t symbol: pops into the property */
+        GetModuleProperty,  /* uint32_t module, uint32_t symbol: pushes the property of the module */
+        SetModuleProperty,  /* uint32_t module, uint32_t symbol: pops into the property of the module */
+        GetCached,          /* uint32_t index: pushes the property cached at index, reading it if it is not */
+        SetCached,          /* uint32_t index: pops into the property cached at index, and forgets it */
+        Index,              /* Pops the index and the array, pushes the element */
+        StoreElement,       /* uint32_t slot: pops the element and the index into the array in slot */
+        Length,             /* Pops an array, pushes its length */
+        NewArray,           /* uint8_t element: pops the length, pushes a new array of zeros */
+        Intrinsic,          /* uint8_t code: pops the arguments of the Intrinsic, pushes its result */
+        Add,                /* Pops two, pushes the result */
+        Subtract,
+        Multiply,
+        Divide,
+        Remainder,
+        /* The same, for operands the verifier has proven are both integers,
+            or both floating point */
+        AddInteger,
+        SubtractInteger,
+        MultiplyInteger,
+        DivideInteger,
+        RemainderInteger,
+        AddFloating,
+        SubtractFloating,
+        MultiplyFloating,
+        DivideFloating,
+        RemainderFloating,
+        Equal,              /* Pops two, pushes whether the first is equal to the second */
+        NotEqual,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        /* The same, for operands the verifier has proven are both integers */
+        EqualInteger,
+        NotEqualInteger,
+        LessInteger,
+        LessEqualInteger,
+        GreaterInteger,
+        GreaterEqualInteger,
+        Not,                /* Pops, pushes whether it is false */
+        Jump,               /* uint32_t to */
+        JumpIfFalse,        /* uint32_t to: pops the condition */
+        JumpIfTrue,         /* uint32_t to: pops the condition */
+        Call,               /* uint32_t procedure: pops the arguments into a new frame */
+        CallNamed,          /* uint32_t symbol, uint32_t arguments: calls a procedure of the Context */
+        CallModule,         /* uint32_t module, uint32_t symbol, uint32_t arguments: calls a procedure of the module */
+        Return,             /* Pops the result, leaves the frame, and pushes the result */
+        Release,            /* Releases the temporaries of the statement */
+        Yield,              /* Suspends the execution */
+        Wait,               /* uint32_t to: pops the condition, and if false suspends to resume at to */
+        End
+    };
+
+    /* The size of the operands that follow op */
+    inline unsigned OperandBytes(Code op){
+        switch(op){
+            case Integer:
+                return sizeof(int64_t);
+            case Floating:
+                return sizeof(double);
+            case Boolean:
+            case NewArray:
+            case Intrinsic:
+                return sizeof(uint8_t);
+            case String:
+            case Load:
+            case Store:
+            case Declare:
+            case DeclareInteger:
+            case GetProperty:
+            case SetProperty:
+            case Jump:
+            case JumpIfFalse:
+            case JumpIfTrue:
+            case Call:
+            case Wait:
+            case GetCached:
+            case SetCached:
+            case StoreElement:
+                return sizeof(uint32_t);
+            case Clear:
+            case GetModuleProperty:
+            case SetModuleProperty:
+            case CallNamed:
+                return sizeof(uint32_t)*2;
+            case CallModule:
+                return sizeof(uint32_t)*3;
+            default:
+                return 0;
+        }
+    }
+}
+
+namespace Intrinsic{
+    inline unsigned Arguments(Code code){
+        switch(code){
+            case Min:
+            case Max:
+                return 2;
+            case Clamp:
+            case Lerp:
+                return 3;
+            default:
+                return 1;
+        }
+    }
+
+    /* Whether it works in floating point whatever it is given */
+    inline bool Real(Code code){
+        return code==Sqrt || code==Sin || code==Cos || code==Lerp;
+    }
+
+    /* The names the standard library gives them, for errors */
+    inline const char *Name(Code code){
+        static const char *const names[] = {"Sqrt", "Sin", "Cos", "Abs", "Min", "Max", "Floor", "Clamp", "Lerp"};
+        return names[code];
+    }
+}
+
+/* A procedure defined by a script. Its code is part of its Program's, unless
+    it was deferred, when it is compiled into a Program of its own the first
+    time it is called. */
+struct Procedure{
+    /* The Program that defines it */
+    struct Program *program;
+    uint32_t symbol;
+    uint32_t entry;
+    /* Arguments are passed in the first slots */
+    uint32_t arguments, slots, stack;
+    /* The Program its code is in, which is NULL until a deferred procedure
+        is compiled */
+    struct Program *code;
+
+    inline bool Deferred() const { return code!=program; }
+};
+
+/* A compiled script. Programs do not refer to their source, which need not
+    outlive them. They are reference counted, since the procedures a Program
+    defines outlive its execution. */
+struct Program{
+
+    /* A property of a Stable Accessor. The module is 0 for the Context's own
+        properties. */
+    struct Cached{
+        uint32_t module, symbol;
+    };
+
+    /* Where the statement whose code starts at pc is in the source. Lines
+        and columns count from 1. */
+    struct Line{
+        uint32_t pc, line, column;
+    };
+
+    /* Where a variable is in scope, so that it can be found by name. The
+        code of procedures lies within the scope of variables of the script,
+        so each is of a frame: 0 for the script, and n for procedure n-1. */
+    struct Local{
+        uint32_t symbol, slot;
+        uint32_t start, end;
+        uint32_t frame;
+    };
+
+    /* The source of a deferred procedure, from `proc' to the end of its
+        body, and the line and column it starts at in the script */
+    struct Deferred{
+        uint32_t procedure;
+        uint32_t offset, size;
+        uint32_t line, column;
+        /* Once it is called */
+        struct Program *compiled;
+    };
+
+    /* A property, module, or procedure an execution read, and how many
+        times its owner had been told it changed when it was read. A property
+        of another Context is counted from its snapshot while it publishes. */
+    struct Read{
+        const Context *owner;
+        uint32_t symbol;
+        uint64_t seen;
+        bool property;
+    };
+
+    explicit Program(Heap *h)
+      : refs(1)
+      , heap(h)
+      , token_code(Utils::HeapAllocator<uint8_t>(h))
+      , string_table(Utils::HeapAllocator<char>(h))
+      , token_procedure_table(Utils::HeapAllocator<struct Procedure>(h))
+      , cached(Utils::HeapAllocator<struct Cached>(h))
+      , targets(Utils::HeapAllocator<uint32_t>(h))
+      , backwards(false)
+      , lines(Utils::HeapAllocator<struct Line>(h))
+      , locals(Utils::HeapAllocator<struct Local>(h))
+      , in_scope(h)
+      , digest(0)
+      , length(0)
+      , title(Utils::HeapAllocator<char>(h))
+      , deferred(Utils::HeapAllocator<struct Deferred>(h))
+      , deferred_source(Utils::HeapAllocator<char>(h))
+      , reads(Utils::HeapAllocator<struct Read>(h))
+      , settled(false)
+      , untracked(false)
+      , slots(0)
+      , stack(0)
+      , context(NULL){}
+
+    ~Program(){
+        ReleaseDeferred();
+    }
+
+    static struct Program *Create(Heap *heap){
+        return new(heap->Allocate(sizeof(struct Program))) Program(heap);
+    }
+
+    unsigned refs;
+    Heap *const heap;
+
+    inline void Retain(){ refs++; }
+
+    void Release(){
+        if(--refs==0){
+            Heap *const h = heap;
+            this->~Program();
+            h->Release(this, sizeof(struct Program));
+        }
+    }
+
+    std::vector<uint8_t, Utils::HeapAllocator<uint8_t> > token_code;
+
+    /* String constants, each terminated */
+    std::vector<char, Utils::HeapAllocator<char> > string_table;
+
+    std::vector<struct Procedure, Utils::HeapAllocator<struct Procedure> > token_procedure_table;
+
+    /* The properties GetCached and SetCached refer to, by index */
+    std::vector<struct Cached, Utils::HeapAllocator<struct Cached> > cached;
+
+    /* Where jumps go, and whether any go back, which the verifier uses to
+        find where paths join */
+    std::vector<uint32_t, Utils::HeapAllocator<uint32_t> > targets;
+    bool backwards;
+
+    /* Ordered by pc, at most one for each pc */
+    std::vector<struct Line, Utils::HeapAllocator<struct Line> > lines;
+
+    std::vector<struct Local, Utils::HeapAllocator<struct Local> > locals;
+
+    /* Indices into locals of the variables in scope, only used while compiling */
+    Utils::FlatTable<uint32_t> in_scope;
+
+    /* A Digest of what the program was compiled from, and its length, to
+        recognise it when it is run again without keeping a copy of it */
+    uint64_t digest;
+    size_t length;
+
+    /* The start of the first line, which names the script when profiling */
+    static const size_t MaxTitle = 40;
+    std::vector<char, Utils::HeapAllocator<char> > title;
+
+    /* Deferred procedures, with all of their source end to end */
+    std::vector<struct Deferred, Utils::HeapAllocator<struct Deferred> > deferred;
+    std::vector<char, Utils::HeapAllocator<char> > deferred_source;
+
+    /* What its last execution in a reactive Context read. It is settled
+        once that execution finishes, unless it read more than MaxReads
+        names, when it is untracked and always executed again. */
+    static const size_t MaxReads = 64;
+    std::vector<struct Read, Utils::HeapAllocator<struct Read> > reads;
+    bool settled, untracked;
+
+    /* The number of slots of the frame, and the deepest the stack grows */
+    uint32_t slots, stack;
+
+    /* The Context a Program compiled on its own was verified for, which
+        alone may run it */
+    const Context *context;
+
+    void Clear(){
+        token_code.clear();
+        string_table.clear();
+        token_procedure_table.clear();
+        cached.clear();
+        targets.clear();
+        backwards = false;
+        lines.clear();
+        locals.clear();
+        in_scope.Clear();
+        digest = 0;
+        length = 0;
+        title.clear();
+        ReleaseDeferred();
+        deferred.clear();
+        deferred_source.clear();
+        reads.clear();
+        settled = untracked = false;
+        slots = stack = 0;
+        context = NULL;
+    }
+
+    void ReleaseDeferred(){
+        for(size_t i = 0; i<deferred.size(); i++){
+            if(deferred[i].compiled)
+                deferred[i].compiled->Release();
+            deferred[i].compiled = NULL;
+        }
+    }
+
+    /* Copies `that' into this Program's Heap, apart from what is only used
+        while compiling */
+    void Assign(const struct Program &that){
+        Clear();
+        token_code.assign(that.token_code.begin(), that.token_code.end());
+        string_table.assign(that.string_table.begin(), that.string_table.end());
+        token_procedure_table.assign(that.token_procedure_table.begin(), that.token_procedure_table.end());
+        for(size_t i = 0; i<token_procedure_table.size(); i++){
+            struct Procedure &p = token_procedure_table[i];
+            p.code = p.Deferred() ? NULL : this;
+            p.program = this;
+        }
+        cached.assign(that.cached.begin(), that.cached.end());
+        targets.assign(that.targets.begin(), that.targets.end());
+        backwards = that.backwards;
+        lines.assign(that.lines.begin(), that.lines.end());
+        locals.assign(that.locals.begin(), that.locals.end());
+        digest = that.digest;
+        length = that.length;
+        title.assign(that.title.begin(), that.title.end());
+        deferred.assign(that.deferred.begin(), that.deferred.end());
+        for(size_t i = 0; i<deferred.size(); i++)
+            deferred[i].compiled = NULL;
+        deferred_source.assign(that.deferred_source.begin(), that.deferred_source.end());
+        slots = that.slots;
+        stack = that.stack;
+        context = that.context;
+    }
+
+    /* Mixes in a word at a time. Each step is invertible, so sources of the
+        same length that differ in one word never collide. */
+    static uint64_t Digest(const char *text, size_t length){
+        const uint64_t prime = (uint64_t(0x00000100)<<32)|0x000001B3;
+        uint64_t h = ((uint64_t(0xCBF29CE4)<<32)|0x84222325)^length;
+        while(length){
+            uint64_t word = 0;
+            const size_t n = length<sizeof(word) ? length : sizeof(word);
+            memcpy(&word, text, n);
+            h = (h^word)*prime;
+            h^=h>>29;
+            text+=n;
+            length-=n;
+        }
+        return h;
+    }
+
+    bool IsFrom(const char *text, size_t n) const {
+        return length==n && digest==Digest(text, n);
+    }
+
+    /* The statement the instruction at pc belongs to, or NULL before the first */
+    const struct Line *FindLine(uint64_t pc) const {
+        size_t low = 0, high = lines.size();
+        while(low<high){
+            const size_t middle = (low+high)/2;
+            if(lines[middle].pc<=pc)
+                low = middle+1;
+            else
+                high = middle;
+        }
+        return low ? &lines[low-1] : NULL;
+    }
+
+    const struct Local *FindLocal(uint32_t symbol, uint64_t pc, uint32_t frame) const {
+        for(size_t i = 0; i<locals.size(); i++){
+            if(locals[i].symbol==symbol && locals[i].frame==frame && locals[i].start<=pc && pc<=locals[i].end)
+                return &locals[i];
+        }
+        return NULL;
+    }
+
+private:
+    Program(const Program &);
+    Program &operator=(const Program &);
+
+};
+
+/* Where a procedure returns to */
+struct Frame{
+    struct Program *program;
+    Context *context;
+    uint64_t pc;
+    struct Value *slots, *top;
+    uint32_t slot_count;
+    struct Value *cache;
+    Arena::Mark statement;
+    const struct Procedure *procedure;
+    struct Frame *caller;
+};
+
+/* The state of a running or suspended Program. It lives in the arena of its
+    Context, and the temporaries of the current statement are kept above it.
+    Each frame, including the current one, holds a reference to its Program. */
+struct Execution{
+    /* The script that was started, which the bottom frame runs */
+    struct Program *script;
+    /* The current frame. Its stack directly follows its slots. */
+    struct Program *program;
+    Context *context;
+    uint64_t pc;
+    struct Value *slots, *top;
+    uint32_t slot_count;
+    /* The values of the frame's Program's cached properties, or Null where
+        they have not been read */
+    struct Value *cache;
+    /* The arena as it was before the execution, and as it is between statements */
+    Arena::Mark base, statement;
+    /* The procedure the current frame runs, or NULL for the script */
+    const struct Procedure *procedure;
+    struct Frame *caller;
+    unsigned depth;
+    /* The execution this one interrupted, if it was started by an Accessor */
+    struct Execution *previous;
+    /* Whether this may suspend. Only one execution of a Context may be
+        suspended, and an execution started by an Accessor can not be. */
+    bool suspendable;
+};
+
+}
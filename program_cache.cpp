@@ -0,0 +1,96 @@
+#include "program_cache.hpp"
+#include "program.hpp"
+#include <cstring>
+
+namespace Lithium{
+
+ProgramCache::ProgramCache()
+  : heap(NULL)
+  , entries(NULL)
+  , capacity(DefaultCapacity)
+  , count(0)
+  , clock(0){}
+
+ProgramCache::~ProgramCache(){
+    SetHeap(NULL);
+}
+
+void ProgramCache::Drop(struct Entry &e){
+    if(e.source)
+        heap->Release(e.source, e.program->length);
+    e.program->Release();
+    e = entries[--count];
+}
+
+void ProgramCache::SetHeap(Heap *h){
+    if(h==heap)
+        return;
+    Clear();
+    if(entries)
+        heap->Release(entries, sizeof(struct Entry)*capacity);
+    entries = NULL;
+    heap = h;
+}
+
+void ProgramCache::DropOldest(){
+    struct Entry *oldest = entries;
+    for(size_t i = 1; i<count; i++){
+        if(entries[i].used<oldest->used)
+            oldest = entries+i;
+    }
+    Drop(*oldest);
+}
+
+void ProgramCache::SetCapacity(size_t n){
+    while(count>n)
+        DropOldest();
+    if(entries && n){
+        entries = static_cast<struct Entry *>(heap->Reallocate(entries,
+            sizeof(struct Entry)*capacity, sizeof(struct Entry)*n));
+    }
+    else if(entries){
+        heap->Release(entries, sizeof(struct Entry)*capacity);
+        entries = NULL;
+    }
+    capacity = n;
+}
+
+struct Program *ProgramCache::Find(const char *source, size_t length){
+    if(!count)
+        return NULL;
+    const uint64_t digest = Program::Digest(source, length);
+    for(size_t i = 0; i<count; i++){
+        struct Entry &e = entries[i];
+        if(e.program->digest==digest && e.program->length==length && (!length || !memcmp(e.source, source, length))){
+            e.used = ++clock;
+            return e.program;
+        }
+    }
+    return NULL;
+}
+
+void ProgramCache::Add(struct Program &p, const char *source, size_t length){
+    if(!capacity || !heap)
+        return;
+    if(!entries)
+        entries = static_cast<struct Entry *>(heap->Allocate(sizeof(struct Entry)*capacity));
+    if(count==capacity)
+        DropOldest();
+
+    struct Entry &e = entries[count++];
+    e.program = &p;
+    e.source = NULL;
+    e.used = ++clock;
+    if(length){
+        e.source = static_cast<char *>(heap->Allocate(length));
+        memcpy(e.source, source, length);
+    }
+    p.Retain();
+}
+
+void ProgramCache::Clear(){
+    while(count)
+        Drop(entries[count-1]);
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "heap.hpp"
+#include <cstddef>
+#include <stdint.h>
+
+namespace Lithium{
+
+struct Program;
+
+/* The Programs of the scripts a Context executed most recently, found again
+    by the Digest of their source. A copy of each source is kept, so that a
+    script is never taken for another with the same Digest. Once full, the
+    script found least recently is dropped for a new one. Like the rest of a
+    Context, it is not thread safe. */
+class ProgramCache{
+    struct Entry{
+        struct Program *program;
+        char *source;
+        /* When it was last found or added */
+        uint64_t used;
+    };
+
+    Heap *heap;
+    struct Entry *entries;
+    size_t capacity, count;
+    uint64_t clock;
+
+    void Drop(struct Entry &e);
+    void DropOldest();
+
+    ProgramCache(const ProgramCache &);
+    ProgramCache &operator=(const ProgramCache &);
+
+public:
+
+    static const size_t DefaultCapacity = 32;
+
+    ProgramCache();
+    ~ProgramCache();
+
+    /* Entries are allocated from `h', and dropped if they were not */
+    void SetHeap(Heap *h);
+
+    /* Drops the entries found least recently if there are more than `n' */
+    void SetCapacity(size_t n);
+    inline size_t Capacity() const { return capacity; }
+    inline size_t Size() const { return count; }
+
+    /* The Program compiled from `source', or NULL */
+    struct Program *Find(const char *source, size_t length);
+
+    /* Keeps a reference to `p', which was compiled from `source' */
+    void Add(struct Program &p, const char *source, size_t length);
+
+    void Clear();
+
+};
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "heap.hpp"
+#include <cstddef>
+
+namespace Lithium{
+namespace Utils{
+
+/* A reference counted, copy-on-write holder. Copies share a single T until
+    one of them asks to Write, at which point it gets its own copy, allocated
+    from the Heap given to Write. T must be constructible from (const T &,
+    Heap *). An empty holder does not allocate at all.
+    The reference count is not atomic, so all holders of a T must be created
+    and destroyed on one thread. Reading through them is safe from any. */
+template<typename T>
+class Shared{
+    struct Node{
+        Node(const T &that, Heap *h)
+          : refs(1), heap(h), t(that, h){}
+        unsigned refs;
+        Heap *const heap;
+        T t;
+    };
+    
+    static Node *CreateNode(const T &that, Heap *heap){
+        return new(heap->Allocate(sizeof(Node))) Node(that, heap);
+    }
+    
+    Node *node;
+    
+    static const T &Empty(){
+        static const T empty = T();
+        return empty;
+    }
+    
+    void Release(){
+        if(node && --node->refs==0){
+            Heap *const heap = node->heap;
+            node->~Node();
+            heap->Release(node, sizeof(Node));
+        }
+        node = NULL;
+    }
+    
+public:
+    
+    Shared()
+      : node(NULL){}
+    
+    Shared(const Shared &that)
+      : node(that.node){
+        if(node) node->refs++;
+    }
+    
+    ~Shared(){
+        Release();
+    }
+    
+    Shared &operator=(const Shared &that){
+        if(that.node) that.node->refs++;
+        Release();
+        node = that.node;
+        return *this;
+    }
+    
+    const T &operator*() const { return node ? node->t : Empty(); }
+    const T *operator->() const { return &(operator*()); }
+    
+    bool IsShared() const { return node && node->refs>1; }
+    
+    /* Detaches from any other holders before returning a mutable T */
+    T &Write(Heap *heap){
+        if(!node){
+            node = CreateNode(Empty(), heap);
+        }
+        else if(node->refs>1){
+            Node *const copy = CreateNode(node->t, heap);
+            node->refs--;
+            node = copy;
+        }
+        return node->t;
+    }
+    
+};
+
+} // namespace Utils
+} // namespace Lithium
@@ -1,8 +1,30 @@
-#include <sys/timeb.h>
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
 #include <stdint.h>
 
+/* CLOCK_MONOTONIC is never set back, unlike the time of day */
+int64_t lithium_nanoseconds(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((int64_t)t.tv_sec*1000000000) + t.tv_nsec;
+}
+
 int64_t lithium_milliseconds(){
-    struct timeb t;
-    ftime(&t);
-    return (t.time*1000) + t.millitm;
+    return lithium_nanoseconds()/1000000;
+}
+
+/* The time stamp counter where there is one, which is cheaper to read than
+    the clock but counts cycles of no fixed length */
+int64_t lithium_cycles(){
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    uint32_t low, high;
+    __asm__ __volatile__ ("rdtsc" : "=a"(low), "=d"(high));
+    return (int64_t)(((uint64_t)high<<32) | low);
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t count;
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r"(count));
+    return (int64_t)count;
+#else
+    return lithium_nanoseconds();
+#endif
 }
@@ -1,11 +1,33 @@
 #define WIN32_LEAN_AND_MEAN 1
 #include <Windows.h>
+#include <intrin.h>
 #include <stdint.h>
 
-int64_t lithium_milliseconds(){
-    SYSTEMTIME t;
-    GetSystemTime(&t);
+/* The performance counter is monotonic, and its frequency is fixed at boot */
+static int64_t lithium_counter(int64_t per_second){
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+
+    /* Split to keep from overflowing */
+    return (count.QuadPart/frequency.QuadPart)*per_second +
+        ((count.QuadPart%frequency.QuadPart)*per_second)/frequency.QuadPart;
+}
 
-    return (t.wSecond*1000) + t.wMilliseconds;
+int64_t lithium_nanoseconds(){
+    return lithium_counter(1000000000);
+}
+
+int64_t lithium_milliseconds(){
+    return lithium_counter(1000);
+}
 
+int64_t lithium_cycles(){
+#if defined(_M_IX86) || defined(_M_X64)
+    return (int64_t)__rdtsc();
+#else
+    LARGE_INTEGER count;
+    QueryPerformanceCounter(&count);
+    return count.QuadPart;
+#endif
 }
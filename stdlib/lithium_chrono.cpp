@@ -1,12 +1,12 @@
 #include "lithium_chrono.hpp"
 #include <cassert>
 
-extern "C" int64_t lithium_milliseconds();
-
 namespace Lithium{
 namespace std{
 namespace Chrono{
 
+Timer timer;
+
 bool TickAccessor(void *a, struct Value &v, Mode mode){
     assert(a==NULL);
     if(mode==Set) return false;
@@ -16,6 +16,47 @@ bool TickAccessor(void *a, struct Value &v, Mode mode){
     return true;
 }
 
-} // namespace Math
+bool NanosAccessor(void *a, struct Value &v, Mode mode){
+    assert(a==NULL);
+    if(mode==Set) return false;
+    
+    IntegerToValue(v, lithium_nanoseconds());
+    
+    return true;
+}
+
+bool CycleAccessor(void *a, struct Value &v, Mode mode){
+    assert(a==NULL);
+    if(mode==Set) return false;
+    
+    IntegerToValue(v, lithium_cycles());
+    
+    return true;
+}
+
+bool TimerAccessor(void *a, struct Value &v, Mode mode){
+    assert(a==NULL);
+    if(mode==Get){
+        IntegerToValue(v, timer.Nanoseconds());
+        return true;
+    }
+    
+    if(v.type==Value::Boolean){
+        if(v.value.boolean)
+            timer.Start();
+        else
+            timer.Stop();
+        return true;
+    }
+    
+    if(v.type==Value::Integer){
+        timer.Reset();
+        return true;
+    }
+    
+    return false;
+}
+
+} // namespace Chrono
 } // namespace std
 } // namespace Lithium
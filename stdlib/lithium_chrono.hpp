@@ -1,10 +1,61 @@
 #pragma once
 #include "lithium.hpp"
 
+/* Monotonic time from an arbitrary start, and the processor's cycle counter,
+    or the nanoseconds where there is none */
+extern "C" int64_t lithium_milliseconds();
+extern "C" int64_t lithium_nanoseconds();
+extern "C" int64_t lithium_cycles();
+
 namespace Lithium{
     namespace std{
         namespace Chrono{
+            
+            /* Adds up the time between each Start and Stop. Stopping a timer
+                that is not running, or starting one that is, does nothing. */
+            class Timer{
+                int64_t started, elapsed;
+                bool running;
+            public:
+                Timer()
+                  : started(0), elapsed(0), running(false){}
+                
+                inline void Start(){
+                    if(!running){
+                        started = lithium_nanoseconds();
+                        running = true;
+                    }
+                }
+                
+                inline void Stop(){
+                    if(running){
+                        elapsed += lithium_nanoseconds()-started;
+                        running = false;
+                    }
+                }
+                
+                inline void Reset(){
+                    elapsed = 0;
+                    running = false;
+                }
+                
+                inline bool IsRunning() const { return running; }
+                
+                /* Includes the time since Start while running */
+                inline int64_t Nanoseconds() const {
+                    return running ? elapsed+lithium_nanoseconds()-started : elapsed;
+                }
+            };
+            
+            /* The Chrono module's timer */
+            extern Timer timer;
+            
             bool TickAccessor(void *a, struct Value &v, Mode mode);
+            bool NanosAccessor(void *a, struct Value &v, Mode mode);
+            bool CycleAccessor(void *a, struct Value &v, Mode mode);
+            /* Setting true starts the timer, false stops it, and an integer
+                resets it to 0 first. Getting gives its nanoseconds. */
+            bool TimerAccessor(void *a, struct Value &v, Mode mode);
         }
     }
 }
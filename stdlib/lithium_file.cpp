@@ -0,0 +1,35 @@
+#include "lithium_file.hpp"
+
+namespace Lithium{
+namespace std{
+
+static struct Error CouldNotOpen(const ::std::string &path){
+    const struct Error e = {false, ::std::string("Could not open ") + path};
+    return e;
+}
+
+struct Error ExecuteFile(Context *ctx, const ::std::string &path){
+    size_t length;
+    const char *const source = lithium_map_file(path.c_str(), &length);
+    if(!source)
+        return CouldNotOpen(path);
+    
+    const struct Error e = ctx->Execute(source, length);
+    lithium_unmap_file(source, length);
+    return e;
+}
+
+struct Error ExecuteFile(Context *ctx, const ::std::string &path, uint64_t budget, enum Status &status){
+    status = Finished;
+    size_t length;
+    const char *const source = lithium_map_file(path.c_str(), &length);
+    if(!source)
+        return CouldNotOpen(path);
+    
+    const struct Error e = ctx->Execute(source, length, budget, status);
+    lithium_unmap_file(source, length);
+    return e;
+}
+
+} // namespace std
+} // namespace Lithium
@@ -0,0 +1,21 @@
+#pragma once
+#include "lithium.hpp"
+#include <stddef.h>
+
+/* Maps a whole file read-only into memory, so that it is read as it is used
+    rather than copied. Returns NULL if it can not be opened or mapped. An
+    empty file gives an empty string. */
+extern "C" const char *lithium_map_file(const char *path, size_t *length);
+extern "C" void lithium_unmap_file(const char *data, size_t length);
+
+namespace Lithium{
+    namespace std{
+        
+        /* Executes the script in the file at `path' as Context::Execute
+            would, compiling it straight from the mapped file. The file is
+            unmapped again before this returns. */
+        struct Error ExecuteFile(Context *ctx, const ::std::string &path);
+        struct Error ExecuteFile(Context *ctx, const ::std::string &path, uint64_t budget, enum Status &status);
+        
+    }
+}
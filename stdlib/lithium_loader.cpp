@@ -0,0 +1,67 @@
+#include "batch.hpp"
+#include "lithium_loader.hpp"
+#include "lithium_file.hpp"
+
+namespace Lithium{
+namespace std{
+
+/* Shared by every thread, which each take the next script until none are left */
+struct Job{
+    Batch *batch;
+    const ::std::vector< ::std::string> *inputs;
+    bool files;
+    long volatile next, worker;
+};
+
+static void Work(void *arg){
+    struct Job &job = *static_cast<struct Job *>(arg);
+    const unsigned worker = lithium_fetch_increment(&job.worker);
+    const long count = job.inputs->size();
+    for(long i = lithium_fetch_increment(&job.next); i<count; i = lithium_fetch_increment(&job.next)){
+        const ::std::string &input = (*job.inputs)[i];
+        if(!job.files){
+            job.batch->Compile(worker, i, input.data(), input.size());
+            continue;
+        }
+        
+        size_t length;
+        const char *const source = lithium_map_file(input.c_str(), &length);
+        if(!source){
+            job.batch->Fail(i, ::std::string("Could not open ") + input);
+            continue;
+        }
+        job.batch->Compile(worker, i, source, length);
+        lithium_unmap_file(source, length);
+    }
+}
+
+static void Load(Context *ctx, const ::std::vector< ::std::string> &inputs, bool files,
+    ::std::vector<struct CompiledScript> &out, unsigned threads){
+    if(threads==0)
+        threads = lithium_processor_count();
+    if(threads>inputs.size())
+        threads = inputs.empty() ? 1 : inputs.size();
+    
+    Batch batch(*ctx, inputs.size(), threads);
+    struct Job job;
+    job.batch = &batch;
+    job.inputs = &inputs;
+    job.files = files;
+    job.next = 0;
+    job.worker = 0;
+    lithium_run_threads(Work, &job, threads);
+    batch.Finish(out);
+}
+
+void CompileScripts(Context *ctx, const ::std::vector< ::std::string> &sources,
+    ::std::vector<struct CompiledScript> &out, unsigned threads){
+    Load(ctx, sources, false, out, threads);
+}
+
+void CompileFiles(Context *ctx, const ::std::vector< ::std::string> &paths,
+    ::std::vector<struct CompiledScript> &out, unsigned threads){
+    Load(ctx, paths, true, out, threads);
+}
+
+} // namespace std
+} // namespace Lithium
@@ -0,0 +1,32 @@
+#pragma once
+#include "lithium.hpp"
+#include <string>
+#include <vector>
+
+/* Calls `function' with `arg' on `count' threads at once, one of which is
+    the caller's, and returns once all of them have. Fewer threads are used if
+    no more can be started. */
+typedef void (*lithium_thread_function)(void *arg);
+extern "C" void lithium_run_threads(lithium_thread_function function, void *arg, unsigned count);
+/* At least 1 */
+extern "C" unsigned lithium_processor_count(void);
+/* Adds one to `counter' atomically, and returns what it was before */
+extern "C" long lithium_fetch_increment(long volatile *counter);
+
+namespace Lithium{
+    namespace std{
+        
+        /* Compiles scripts for `ctx' with a Batch, on `threads' threads, or
+            one for each processor if it is 0. `out' gets a CompiledScript
+            for each, in the same order, and is the same however many threads
+            there are. Nothing else may use `ctx' until this returns. */
+        void CompileScripts(Context *ctx, const ::std::vector< ::std::string> &sources,
+            ::std::vector<struct CompiledScript> &out, unsigned threads = 0);
+        
+        /* The same, for the scripts in the files at `paths', each of which
+            is mapped into memory as ExecuteFile does */
+        void CompileFiles(Context *ctx, const ::std::vector< ::std::string> &paths,
+            ::std::vector<struct CompiledScript> &out, unsigned threads = 0);
+        
+    }
+}
@@ -9,7 +9,7 @@ bool PiAccessor(void *a, struct Value &v, Mode mode){
     assert(a==NULL);
     if(mode==Set) return false;
     
-    FloatingToValue(v, 3.141592653589793238f);
+    FloatingToValue(v, 3.141592653589793238);
     
     return true;
 }
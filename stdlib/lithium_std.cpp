@@ -11,12 +11,24 @@ Context
 
 static void InitMath(){
     math = new Context(NULL);
-    math->AddAccessor("Pi", Math::PiAccessor);
+    math->AddAccessor("Pi", Math::PiAccessor, Constant);
+    math->AddIntrinsic("Sqrt", Intrinsic::Sqrt);
+    math->AddIntrinsic("Sin", Intrinsic::Sin);
+    math->AddIntrinsic("Cos", Intrinsic::Cos);
+    math->AddIntrinsic("Abs", Intrinsic::Abs);
+    math->AddIntrinsic("Min", Intrinsic::Min);
+    math->AddIntrinsic("Max", Intrinsic::Max);
+    math->AddIntrinsic("Floor", Intrinsic::Floor);
+    math->AddIntrinsic("Clamp", Intrinsic::Clamp);
+    math->AddIntrinsic("Lerp", Intrinsic::Lerp);
 }
 
 static void InitChrono(){
     chrono = new Context(NULL);
     chrono->AddAccessor("Ticks", Chrono::TickAccessor);
+    chrono->AddAccessor("Nanos", Chrono::NanosAccessor);
+    chrono->AddAccessor("CycleCount", Chrono::CycleAccessor);
+    chrono->AddAccessor("Timer", Chrono::TimerAccessor);
 }
 
 void InitModules(Context *ctx){
@@ -0,0 +1,44 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+const char *lithium_map_file(const char *path, size_t *length){
+    struct stat info;
+    void *data;
+    const int fd = open(path, O_RDONLY);
+
+    *length = 0;
+    if(fd<0)
+        return NULL;
+    if(fstat(fd, &info)!=0 || !S_ISREG(info.st_mode)){
+        close(fd);
+        return NULL;
+    }
+
+    /* Nothing can be mapped with a length of 0 */
+    if(info.st_size==0){
+        close(fd);
+        return "";
+    }
+
+    /* The mapping keeps the file open */
+    data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data==MAP_FAILED)
+        return NULL;
+
+    /* Scripts are compiled in one pass from start to end */
+    posix_madvise(data, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+
+    *length = (size_t)info.st_size;
+    return (const char *)data;
+}
+
+void lithium_unmap_file(const char *data, size_t length){
+    if(data && length)
+        munmap((void *)data, length);
+}
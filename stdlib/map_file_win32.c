@@ -0,0 +1,43 @@
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#include <stddef.h>
+
+const char *lithium_map_file(const char *path, size_t *length){
+    LARGE_INTEGER size;
+    HANDLE mapping;
+    const void *data;
+    const HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    *length = 0;
+    if(file==INVALID_HANDLE_VALUE)
+        return NULL;
+    if(!GetFileSizeEx(file, &size) || (ULONGLONG)size.QuadPart>(ULONGLONG)((size_t)-1)){
+        CloseHandle(file);
+        return NULL;
+    }
+
+    /* Nothing can be mapped with a length of 0 */
+    if(size.QuadPart==0){
+        CloseHandle(file);
+        return "";
+    }
+
+    /* The view keeps the file and the mapping open */
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(mapping==NULL)
+        return NULL;
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if(data==NULL)
+        return NULL;
+
+    *length = (size_t)size.QuadPart;
+    return (const char *)data;
+}
+
+void lithium_unmap_file(const char *data, size_t length){
+    if(data && length)
+        UnmapViewOfFile(data);
+}
@@ -0,0 +1,43 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef void (*lithium_thread_function)(void *arg);
+
+struct lithium_thread_start{
+    lithium_thread_function function;
+    void *arg;
+};
+
+static void *lithium_thread_main(void *start){
+    const struct lithium_thread_start *const s = (const struct lithium_thread_start *)start;
+    s->function(s->arg);
+    return NULL;
+}
+
+void lithium_run_threads(lithium_thread_function function, void *arg, unsigned count){
+    struct lithium_thread_start start;
+    pthread_t *const threads = count>1 ? (pthread_t *)malloc(sizeof(pthread_t)*(count-1)) : NULL;
+    unsigned started = 0;
+
+    start.function = function;
+    start.arg = arg;
+    while(threads && started+1<count && pthread_create(threads+started, NULL, lithium_thread_main, &start)==0)
+        started++;
+
+    function(arg);
+
+    while(started)
+        pthread_join(threads[--started], NULL);
+    free(threads);
+}
+
+unsigned lithium_processor_count(void){
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count>0 ? (unsigned)count : 1;
+}
+
+long lithium_fetch_increment(long volatile *counter){
+    return __sync_fetch_and_add(counter, 1);
+}
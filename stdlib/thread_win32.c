@@ -0,0 +1,50 @@
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#include <stdlib.h>
+
+typedef void (*lithium_thread_function)(void *arg);
+
+struct lithium_thread_start{
+    lithium_thread_function function;
+    void *arg;
+};
+
+static DWORD WINAPI lithium_thread_main(LPVOID start){
+    const struct lithium_thread_start *const s = (const struct lithium_thread_start *)start;
+    s->function(s->arg);
+    return 0;
+}
+
+void lithium_run_threads(lithium_thread_function function, void *arg, unsigned count){
+    struct lithium_thread_start start;
+    HANDLE *const threads = count>1 ? (HANDLE *)malloc(sizeof(HANDLE)*(count-1)) : NULL;
+    unsigned started = 0;
+
+    start.function = function;
+    start.arg = arg;
+    while(threads && started+1<count){
+        threads[started] = CreateThread(NULL, 0, lithium_thread_main, &start, 0, NULL);
+        if(threads[started]==NULL)
+            break;
+        started++;
+    }
+
+    function(arg);
+
+    /* WaitForMultipleObjects takes at most 64 */
+    while(started){
+        WaitForSingleObject(threads[--started], INFINITE);
+        CloseHandle(threads[started]);
+    }
+    free(threads);
+}
+
+unsigned lithium_processor_count(void){
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (unsigned)info.dwNumberOfProcessors : 1;
+}
+
+long lithium_fetch_increment(long volatile *counter){
+    return InterlockedIncrement(counter)-1;
+}
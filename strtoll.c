@@ -1,10 +1,10 @@
 #include "strtoll.h"
-#include <math.h>
+#include <stdlib.h>
 
 unsigned HexDigitValue(char c){
     if(c<='9') return c-'0';
-    if(c<='F') return c-'A';
-    return c-'a';
+    if(c<='F') return c-'A'+10;
+    return c-'a'+10;
 }
 
 int IsDecDigit(char c){
@@ -99,25 +99,28 @@ int StrToInt64(const char *string, int64_t *dest){
         string++;
         if(*string=='x' || *string=='X'){
             string++;
-            if(!HexStrToInt64(string, &value)) return -1;
+            if(HexStrToInt64(string, &value)!=1) return -1;
         }
         else if(*string=='b' || *string=='B'){
             string++;
-            if(!BinStrToInt64(string, &value)) return -1;
+            if(BinStrToInt64(string, &value)!=1) return -1;
         }
-        else if(!OctStrToInt64(string, &value)) return -1;
+        else if(OctStrToInt64(string, &value)!=1) return -1;
     }
-    else if(!DecStrToInt64(string, &value)) return -1;
+    else if(DecStrToInt64(string, &value)!=1) return -1;
     
     dest[0] = value;
     if(negated) dest[0] = -dest[0];
     return 1;
 }
 
-int StrToFloat(const char *string, float *dest){
+/* Only decimal digits with an optional fraction and exponent are accepted,
+ * which is how floating point numbers are written out. Adding up the digits
+ * would round at each one, so the number itself is left to strtod, which
+ * rounds once. */
+int StrToDouble(const char *string, double *dest){
 
-    int negated = 0;
-    uint64_t numerator = 0, denominator = 0;
+    const char *i;
 
     /* Skip any whitespace */
     while(*string!='\0'){
@@ -129,60 +132,43 @@ int StrToFloat(const char *string, float *dest){
         string++;
     }
 
-    /* Get a sign if one exists */
-    if(*string=='-'){
-        negated = 1;
-        string++;
-    }
-    else if(*string=='+'){
-        negated = 0;
-        string++;
-    }
+    /* An optional sign, and the whole number part */
+    i = string;
+    if(*i=='-' || *i=='+')
+        i++;
 
-    /* Get the whole number part of the string */
-    if(!IsDecDigit(*string)) return -1;
+    if(!IsDecDigit(*i)) return -1;
 
     do{
-    
-        if(!IsDecDigit(*string)){
-            numerator*=10;
-            numerator+=(*string)-'0';
-        }
-    
-    
-    }while(IsDecDigit(*string));
-    
-    /* Apply the sign. We do it early to make returning integers simpler. */
-    if(negated) numerator = -numerator;
-    
-    /* If this is the end of the string (it was just an integer!?), return now */
-    if(*string=='\0'){
-        dest[0] = numerator;
-        return 1;
+        i++;
+    }while(IsDecDigit(*i));
+
+    /* The decimal point and fraction, unless it was just an integer */
+    if(*i=='.'){
+        i++;
+        while(IsDecDigit(*i))
+            i++;
     }
-     
-    /* The decimal point */
-    if(*string!='.') return -1;
-    
-    string++;
-    {
-        unsigned decimal_places = 0;
-        /* Get the decimal portion of the number */
-        do{
-            if(!IsDecDigit(*string)) return -1;
-            
-            denominator*=10;
-            denominator+=(*string)-'0';
-            decimal_places++;
-        }while(*string!='\0');
-  
-        /* We already applied the sign, so just do the division and return */
-        dest[0] = 
-            /* Whole number portion */
-            ((double)numerator)
-            /* The remains  - - - - - Divided by ten times the number of decimal places removed */
-            / (((double)denominator)/pow(10.0, decimal_places));
+
+    /* The exponent */
+    if(*i=='e' || *i=='E'){
+        i++;
+        if(*i=='-' || *i=='+')
+            i++;
+        if(!IsDecDigit(*i)) return -1;
+        while(IsDecDigit(*i))
+            i++;
     }
 
+    if(*i!='\0') return -1;
+
+    dest[0] = strtod(string, NULL);
+    return 1;
+}
+
+int StrToFloat(const char *string, float *dest){
+    double value;
+    if(StrToDouble(string, &value)!=1) return -1;
+    dest[0] = (float)value;
     return 1;
 }
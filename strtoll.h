@@ -6,6 +6,7 @@ extern "C" {
 #endif
 int StrToInt64(const char *string, int64_t *dest);
 int StrToFloat(const char *string, float *dest);
+int StrToDouble(const char *string, double *dest);
 
 /* Prefixed versions do NOT have '0', '0x', or '0b' in their strings, or a '-' or '+' in front.
  * They may also leave `dest' in an inconsistent state on error. */
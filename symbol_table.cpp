@@ -0,0 +1,109 @@
+#include "symbol_table.hpp"
+#include <cstring>
+
+namespace Lithium{
+
+SymbolTable::SymbolTable()
+  : index(16, 0)
+  , lower(NULL){
+    /* Symbol 0 is the empty name, and is never found */
+    text.push_back('\0');
+    offsets.push_back(0);
+    lengths.push_back(0);
+    hashes.push_back(0);
+}
+
+SymbolTable::SymbolTable(const SymbolTable &l, Heap *heap)
+  : text(Utils::HeapAllocator<char>(heap))
+  , offsets(Utils::HeapAllocator<uint32_t>(heap))
+  , lengths(Utils::HeapAllocator<uint32_t>(heap))
+  , hashes(Utils::HeapAllocator<uint32_t>(heap))
+  , index(16, 0, Utils::HeapAllocator<uint32_t>(heap))
+  , lower(&l){
+    text.push_back('\0');
+    offsets.push_back(0);
+    lengths.push_back(0);
+    hashes.push_back(0);
+}
+
+/* FNV-1a */
+uint32_t SymbolTable::Hash(const char *name, size_t len){
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i<len; i++){
+        h ^= (uint8_t)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+uint32_t SymbolTable::Find(const char *name, size_t len) const {
+    if(lower){
+        const uint32_t s = lower->Find(name, len);
+        if(s!=0)
+            return s;
+        const uint32_t own = FindOwn(name, len, Hash(name, len));
+        return own ? (own|Scratch) : 0;
+    }
+    return FindOwn(name, len, Hash(name, len));
+}
+
+uint32_t SymbolTable::FindOwn(const char *name, size_t len, uint32_t h) const {
+    const uint32_t mask = index.size()-1;
+    for(uint32_t i = h&mask; index[i]!=0; i = (i+1)&mask){
+        const uint32_t s = index[i];
+        if(hashes[s]==h && lengths[s]==len && memcmp(&(text[offsets[s]]), name, len)==0)
+            return s;
+    }
+    return 0;
+}
+
+void SymbolTable::Grow(){
+    Vector grown(index.size()<<1, 0, index.get_allocator());
+    const uint32_t mask = grown.size()-1;
+    for(uint32_t s = 1; s<offsets.size(); s++){
+        uint32_t i = hashes[s]&mask;
+        while(grown[i]!=0)
+            i = (i+1)&mask;
+        grown[i] = s;
+    }
+    index.swap(grown);
+}
+
+uint32_t SymbolTable::Intern(const char *name, size_t len){
+    if(lower){
+        const uint32_t s = lower->Find(name, len);
+        if(s!=0) return s;
+    }
+    
+    const uint32_t h = Hash(name, len);
+    {
+        const uint32_t s = FindOwn(name, len, h);
+        if(s!=0) return lower ? (s|Scratch) : s;
+    }
+    
+    if((offsets.size()+1)*4 > index.size()*3)
+        Grow();
+    
+    const uint32_t s = offsets.size();
+    
+    offsets.push_back(text.size());
+    lengths.push_back(len);
+    hashes.push_back(h);
+    text.insert(text.end(), name, name+len);
+    text.push_back('\0');
+    
+    const uint32_t mask = index.size()-1;
+    uint32_t i = h&mask;
+    while(index[i]!=0)
+        i = (i+1)&mask;
+    index[i] = s;
+    
+    return lower ? (s|Scratch) : s;
+}
+
+SymbolTable &Symbols(){
+    static SymbolTable symbols;
+    return symbols;
+}
+
+}
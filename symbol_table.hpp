@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "heap.hpp"
+
+namespace Lithium{
+
+/* Interns names, so that tables can be keyed by small integers instead of
+    strings. Symbol 0 is never a valid name. All names are stored end to end
+    in one buffer, and the hash index only holds symbol ids.
+    
+    A table may be layered on top of another, which it only reads. Names the
+    lower table has keep their symbols, and others are interned in the upper
+    table as Scratch symbols. This lets a thread intern names without
+    changing a table that other threads are reading. */
+class SymbolTable{
+    typedef std::vector<uint32_t, Utils::HeapAllocator<uint32_t> > Vector;
+    std::vector<char, Utils::HeapAllocator<char> > text;
+    Vector offsets;
+    Vector lengths;
+    Vector hashes;
+    /* Open addressed, power of two sized index of symbol ids */
+    Vector index;
+    
+    const SymbolTable *const lower;
+    
+    static uint32_t Hash(const char *name, size_t len);
+    void Grow();
+    uint32_t FindOwn(const char *name, size_t len, uint32_t h) const;
+    
+    SymbolTable(const SymbolTable &);
+    SymbolTable &operator=(const SymbolTable &);
+    
+public:
+    
+    /* Set in the symbols of an upper table */
+    static const uint32_t Scratch = 0x80000000u;
+    
+    SymbolTable();
+    
+    /* Allocates from `heap', and reads `lower' without ever changing it */
+    SymbolTable(const SymbolTable &lower, Heap *heap);
+    
+    /* Returns 0 if the name has never been interned */
+    uint32_t Find(const char *name, size_t len) const;
+    inline uint32_t Find(const std::string &name) const { return Find(name.c_str(), name.size()); }
+    
+    uint32_t Intern(const char *name, size_t len);
+    inline uint32_t Intern(const std::string &name){ return Intern(name.c_str(), name.size()); }
+    
+    inline const char *Name(uint32_t symbol) const {
+        if(lower && !(symbol&Scratch))
+            return lower->Name(symbol);
+        return &(text[offsets[symbol&~Scratch]]);
+    }
+    inline size_t Length(uint32_t symbol) const {
+        if(lower && !(symbol&Scratch))
+            return lower->Length(symbol);
+        return lengths[symbol&~Scratch];
+    }
+    /* Of this table alone */
+    inline size_t Size() const { return offsets.size(); }
+    
+};
+
+/* The symbol table used to key the tables of all Contexts. Interning is not
+    thread safe, and only happens when names are added to a Context or a
+    script is compiled by it. It is allocated from the global Heap. */
+SymbolTable &Symbols();
+
+}
@@ -1,7 +1,10 @@
+/* For PRId64 */
+#define __STDC_FORMAT_MACROS
 #include "lithium.hpp"
 #include "strtoll.h"
 #include <cstdlib>
 #include <cstdio>
+#include <inttypes.h>
 
 #if defined(_MSC_VER)
 
@@ -35,11 +38,12 @@ Value::Type MutualCast(Value::Type a, Value::Type b){
             else 
                 return Value::Floating;
         case Value::String: return Value::String;
+        case Value::Array: return Value::Array;
     }
     return Value::Null;
 }
 
-/* Numeric types are directly converted. Strings may convert -- see strtoll. Booleans fail. */
+/* Numeric types are directly converted. Strings may convert -- see strtoll. Booleans and arrays fail. */
 struct Error ValueToInteger(const struct Value &v, int64_t &out){
     struct Error e = {true};
     switch(v.type){
@@ -58,17 +62,21 @@ struct Error ValueToInteger(const struct Value &v, int64_t &out){
             out = (int64_t)v.value.floating;
             break;
         case Value::String:
-            if(!StrToInt64(v.value.string, &out)){
+            if(StrToInt64(v.value.string, &out)!=1){
                 e.succeeded = false;
                 e.error = std::string("Cannot convert string ``") + v.value.string + "'' to int";
             }
             break;
+        case Value::Array:
+            e.succeeded = false;
+            e.error = "Cannot convert array to int";
+            break;
     }
     return e;
 }
 
-/* Numeric types are directly converted. Strings may convert -- see strtoll. Booleans fail. */
-struct Error ValueToFloating(const struct Value &v, float &out){
+/* Numeric types are directly converted. Strings may convert -- see strtoll. Booleans and arrays fail. */
+struct Error ValueToFloating(const struct Value &v, double &out){
     struct Error e = {true};
     switch(v.type){
         case Value::Null:
@@ -80,22 +88,34 @@ struct Error ValueToFloating(const struct Value &v, float &out){
             e.error = "Cannot convert bool to float";
             break;
         case Value::Integer:
-            out = (float)v.value.integer;
+            out = (double)v.value.integer;
             break;
         case Value::Floating:
             out = v.value.floating;
             break;
         case Value::String:
-            if(!StrToFloat(v.value.string, &out)){
+            if(StrToDouble(v.value.string, &out)!=1){
                 e.succeeded = false;
                 e.error = std::string("Cannot convert string ``") + v.value.string + "'' to float";
             }
             break;
+        case Value::Array:
+            e.succeeded = false;
+            e.error = "Cannot convert array to float";
+            break;
     }
     return e;
 }
 
-/* Anything can be a string... */
+struct Error ValueToFloating(const struct Value &v, float &out){
+    double d;
+    struct Error e = ValueToFloating(v, d);
+    if(e.succeeded)
+        out = (float)d;
+    return e;
+}
+
+/* Anything but an array can be a string... */
 struct Error ValueToString(const struct Value &v, std::string &out){
     char buffer[80];
     struct Error e = {true};
@@ -108,21 +128,28 @@ struct Error ValueToString(const struct Value &v, std::string &out){
             out.assign(v.value.boolean?"true":"false");
             break;
         case Value::Integer:
-            SNPrintfShim(buffer, 79, "%i", (int)v.value.integer);
+            SNPrintfShim(buffer, 79, "%" PRId64, v.value.integer);
             out.assign(buffer);
             break;
         case Value::Floating:
-            SNPrintfShim(buffer, 79, "%d", (int)v.value.floating);
+            /* As short as it can be while still reading back the same */
+            SNPrintfShim(buffer, 79, "%.15g", v.value.floating);
+            if(strtod(buffer, NULL)!=v.value.floating)
+                SNPrintfShim(buffer, 79, "%.17g", v.value.floating);
             out.assign(buffer);
             break;
         case Value::String:
             out.assign(v.value.string);
             break;
+        case Value::Array:
+            e.succeeded = false;
+            e.error = "Cannot convert array to string";
+            break;
     }
     return e;
 }
 
-/* Anything can be a boolean... */
+/* Anything but an array can be a boolean... */
 struct Error ValueToBoolean(const struct Value &v, bool &out){
     struct Error e = {true};
     switch(v.type){
@@ -137,11 +164,15 @@ struct Error ValueToBoolean(const struct Value &v, bool &out){
             out = v.value.integer>0;
             break;
         case Value::Floating:
-            out = v.value.floating>0.0f;
+            out = v.value.floating>0.0;
             break;
         case Value::String:
             out = (v.value.string!=NULL) && (v.value.string[0]!='\0');
             break;
+        case Value::Array:
+            e.succeeded = false;
+            e.error = "Cannot convert array to bool";
+            break;
     }
     return e;
 }
@@ -151,7 +182,7 @@ void IntegerToValue(struct Value &v, int64_t in){
     v.value.integer = in;
 }
 
-void FloatingToValue(struct Value &v, float in){
+void FloatingToValue(struct Value &v, double in){
     v.type = Value::Floating;
     v.value.floating = in;
 }
@@ -160,7 +191,7 @@ void StringToValue(struct Value &v, const std::string &in){
     const uint64_t len = in.size();
     
     v.type = Value::String;
-    v.value.string = (char *)malloc((size_t)len+1);
+    v.value.string = (char *)GlobalHeap().Allocate((size_t)len+1);
     memcpy(v.value.string, in.c_str(), (size_t)len+1);
 }
 
@@ -169,4 +200,9 @@ void BooleanToValue(struct Value &v, bool in){
     v.value.boolean = in;
 }
 
+void ArrayToValue(struct Value &v, struct Array &in){
+    v.type = Value::Array;
+    v.value.array = &in;
+}
+
 }
@@ -0,0 +1,594 @@
+#include "verifier.hpp"
+#include "bytecode_utils.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace Lithium{
+
+/* The type of anything only known when it runs: the results of Accessors
+    and procedures, and variables set differently on different paths */
+static const uint8_t Unknown = 0xFF;
+
+/* Walks each frame's code, tracking the type of every slot and every Value
+    on the stack. Where paths join the types are merged, and the walk is
+    repeated until they settle. */
+class Verifier{
+    struct Program &program;
+    const Context &context;
+    Arena &arena;
+    const SymbolTable &symbols;
+    uint8_t *const code;
+    const uint32_t size;
+
+    /* Code that is jumped to, or that a frame starts at, and the types on
+        entering it from every path seen so far. Each runs up to the next. */
+    struct Block{
+        uint8_t *types;
+        uint32_t slots, stack, depth;
+        bool reached, queued;
+    };
+    uint32_t *starts, count;
+    struct Block *blocks;
+
+    /* Blocks whose types have changed since they were last walked */
+    uint32_t *queue, queued;
+
+    /* The block being walked */
+    uint8_t *types;
+    uint32_t slots, stack, depth;
+
+    /* Types are only final once every path is merged, so only the last walk
+        reports errors and rewrites instructions */
+    bool final;
+
+    template<typename T>
+    T *Allocate(size_t n){
+        return static_cast<T *>(arena.Allocate(sizeof(T)*n));
+    }
+
+public:
+
+    Verifier(struct Program &p, const Context &c, Arena &a, const SymbolTable &t)
+      : program(p)
+      , context(c)
+      , arena(a)
+      , symbols(t)
+      , code(&p.token_code.front())
+      , size(p.token_code.size())
+      , starts(NULL)
+      , count(0)
+      , blocks(NULL)
+      , queue(NULL)
+      , queued(0)
+      , types(NULL)
+      , slots(0)
+      , stack(0)
+      , depth(0)
+      , final(false){
+        err.succeeded = true;
+    }
+
+    struct Error err;
+
+    void Fail(const std::string &error){
+        if(final && err.succeeded){
+            err.succeeded = false;
+            err.error = error;
+        }
+    }
+
+    void Rewrite(uint64_t at, Op::Code op){
+        if(final)
+            code[at] = op;
+    }
+
+    inline void Push(uint8_t type){ types[slots+depth++] = type; }
+    inline uint8_t Pop(){ return types[slots+--depth]; }
+
+    inline uint32_t Find(uint32_t pc) const {
+        return std::lower_bound(starts, starts+count, pc)-starts;
+    }
+
+    /* Enters a block with the current types */
+    void Merge(uint32_t index){
+        struct Block &b = blocks[index];
+        bool changed = false;
+
+        if(!b.reached){
+            b.reached = true;
+            b.slots = slots;
+            b.stack = stack;
+            b.depth = depth;
+            b.types = Allocate<uint8_t>(slots+stack);
+            memcpy(b.types, types, slots+stack);
+            changed = true;
+        }
+        else{
+            for(uint32_t i = 0; i<b.slots+b.depth; i++){
+                if(b.types[i]!=types[i] && b.types[i]!=Unknown){
+                    b.types[i] = Unknown;
+                    changed = true;
+                }
+            }
+        }
+
+        if(changed && !b.queued){
+            b.queued = true;
+            queue[queued++] = index;
+        }
+    }
+
+    /* Starts a frame at pc, with its arguments in its first slots */
+    void Enter(uint32_t pc, uint32_t frame_slots, uint32_t frame_stack, uint32_t arguments){
+        slots = frame_slots;
+        stack = frame_stack;
+        depth = 0;
+        memset(types, Value::Null, slots+stack);
+        memset(types, Unknown, arguments);
+        Merge(Find(pc));
+    }
+
+    /* Whether a Value of type `t' might be converted to `to' */
+    static bool Converts(uint8_t t, Value::Type to, struct Error &e){
+        if(t!=Value::Null && t!=Value::Boolean && t!=Value::Array)
+            return true;
+
+        const struct Value v = {static_cast<Value::Type>(t)};
+        int64_t n;
+        double f;
+        bool c;
+        std::string s;
+        switch(to){
+            case Value::Integer: e = ValueToInteger(v, n); break;
+            case Value::Floating: e = ValueToFloating(v, f); break;
+            case Value::Boolean: e = ValueToBoolean(v, c); break;
+            case Value::String: e = ValueToString(v, s); break;
+            case Value::Null:
+            case Value::Array: break;
+        }
+        return e.succeeded;
+    }
+
+    void Convert(uint8_t t, Value::Type to, const char *prefix){
+        struct Error e = {true};
+        if(final && !Converts(t, to, e))
+            Fail(prefix + e.error);
+    }
+
+    void Arithmetic(uint64_t at, Op::Code op){
+        static const char *const nouns[] = {"addition", "subtraction", "multiplication", "division", "remainder"};
+        static const char *const verbs[] = {"add", "subtract", "multiply", "divide", "modulus"};
+        const unsigned n = op-Op::Add;
+
+        const uint8_t second = Pop(), first = Pop();
+        switch(first){
+            case Value::Null:
+                Fail(std::string("Invalid Null expression in ") + nouns[n]);
+                Push(Unknown);
+                return;
+            case Value::Boolean:
+                Fail(std::string("Cannot ") + verbs[n] + " boolean expressions");
+                Push(Unknown);
+                return;
+            case Value::String:
+                if(op==Op::Add)
+                    Convert(second, Value::String, "");
+                else
+                    Fail(std::string("Cannot ") + verbs[n] + " string expressions");
+                Push(Value::String);
+                return;
+            case Value::Integer:
+                if(second==Value::Integer)
+                    Rewrite(at, static_cast<Op::Code>(Op::AddInteger+n));
+                else
+                    Convert(second, Value::Integer, "Cannot perform arithmetic: ");
+                Push(Value::Integer);
+                return;
+            case Value::Floating:
+                if(second==Value::Floating)
+                    Rewrite(at, static_cast<Op::Code>(Op::AddFloating+n));
+                else
+                    Convert(second, Value::Floating, "Cannot perform arithmetic: ");
+                Push(Value::Floating);
+                return;
+            case Value::Array:
+                if(op==Op::Remainder)
+                    Fail(std::string("Cannot ") + verbs[n] + " array expressions");
+                else if(second!=Value::Array)
+                    Convert(second, Value::Floating, "Cannot perform arithmetic: ");
+                Push(Value::Array);
+                return;
+        }
+        Push(Unknown);
+    }
+
+    void Comparison(uint64_t at, Op::Code op){
+        const uint8_t second = Pop(), first = Pop();
+        if(first==Value::Null || second==Value::Null)
+            Fail("Invalid Null expression in comparison");
+        else if(first==Value::Array || second==Value::Array)
+            Fail("Cannot compare array expressions");
+        else if(first==Value::Integer && second==Value::Integer)
+            Rewrite(at, static_cast<Op::Code>(Op::EqualInteger+(op-Op::Equal)));
+        Push(Value::Boolean);
+    }
+
+    /* The result of an Intrinsic is in the type of its first argument, or
+        floating point for those that work in floating point */
+    void CallIntrinsic(Intrinsic::Code f){
+        const unsigned arguments = Intrinsic::Arguments(f);
+        const uint8_t *const rest = types+slots+depth-arguments+1;
+        const uint8_t first = rest[-1];
+        depth-=arguments;
+        switch(first){
+            case Value::Null:
+                Fail(std::string("Invalid Null expression in ") + Intrinsic::Name(f));
+                Push(Unknown);
+                return;
+            case Value::Boolean:
+            case Value::String:
+                Fail(std::string("Cannot use ") + (first==Value::Boolean ? "boolean" : "string") +
+                    " expressions in " + Intrinsic::Name(f));
+                Push(Unknown);
+                return;
+        }
+        const bool real = Intrinsic::Real(f);
+        const Value::Type to = (first==Value::Integer && !real) ? Value::Integer : Value::Floating;
+        /* Only arrays take arrays, and Lerp takes a number for how far */
+        for(unsigned i = 0; i+1<arguments; i++){
+            if(rest[i]!=Value::Array || first!=Value::Array || (f==Intrinsic::Lerp && i==1))
+                Convert(rest[i], to, "Cannot perform arithmetic: ");
+        }
+        Push((first==Value::Integer && real) ? static_cast<uint8_t>(Value::Floating) : first);
+    }
+
+    void Indexed(uint8_t t){
+        if(t!=Unknown && t!=Value::Array)
+            Fail("Only arrays can be indexed");
+    }
+
+    const Context *Module(uint32_t symbol){
+        const Context *const module = context.GetModule(symbol);
+        if(!module)
+            Fail(std::string("No Such Module \"") + symbols.Name(symbol) + '"');
+        return module;
+    }
+
+    void Property(const Context &c, uint32_t symbol){
+        if(!c.properties->Find(symbol))
+            Fail(std::string("Undefined Property \"") + symbols.Name(symbol) + '"');
+        Push(Unknown);
+    }
+
+    void SetProperty(const Context &c, uint32_t symbol){
+        const uint8_t t = Pop();
+        const struct Binding *const b = c.properties->Find(symbol);
+        if(!final || (b && b->kind==Binding::Callback))
+            return;
+
+        struct Error e = {true};
+        if(!b)
+            Fail(std::string("Property ") + symbols.Name(symbol) + " does not exist");
+        else if(b->kind==Binding::Typed && !(b->type==Value::Integer ? b->bind.integer.set!=NULL :
+            b->type==Value::Floating ? b->bind.floating.set!=NULL : b->bind.boolean.set!=NULL))
+            Fail(std::string("Cannot set property ") + symbols.Name(symbol) + ": property is read only");
+        else if(!Converts(t, b->type, e))
+            Fail(std::string("Cannot set property ") + symbols.Name(symbol) + ": " + e.error);
+    }
+
+    /* Procedures called by name may be defined later in the same script */
+    void Call(const Context &c, uint32_t symbol, uint32_t arguments, bool own){
+        const struct Procedure *p = NULL;
+        for(size_t i = 0; own && i<program.token_procedure_table.size(); i++){
+            if(program.token_procedure_table[i].symbol==symbol)
+                p = &program.token_procedure_table[i];
+        }
+        if(!p){
+            struct Procedure *const *const found = c.token_procedure_table.Find(symbol);
+            p = found ? *found : NULL;
+        }
+
+        if(!p){
+            Fail(std::string("Undefined Procedure \"") + symbols.Name(symbol) + '"');
+        }
+        else if(p->arguments!=arguments){
+            char counts[48];
+            sprintf(counts, " takes %u arguments, not %u", p->arguments, arguments);
+            Fail(std::string("Procedure ") + symbols.Name(symbol) + counts);
+        }
+
+        depth-=arguments;
+        Push(Unknown);
+    }
+
+    void Walk(uint32_t index){
+        const struct Block &b = blocks[index];
+        slots = b.slots;
+        stack = b.stack;
+        depth = b.depth;
+        memcpy(types, b.types, slots+stack);
+
+        uint64_t pc = starts[index];
+        const uint64_t next = (index+1<count) ? starts[index+1] : size;
+        for(;;){
+            const uint64_t at = pc;
+            const Op::Code op = static_cast<Op::Code>(code[pc++]);
+            switch(op){
+                case Op::Null:
+                    Push(Value::Null);
+                    break;
+                case Op::Integer:
+                    pc+=sizeof(int64_t);
+                    Push(Value::Integer);
+                    break;
+                case Op::Floating:
+                    pc+=sizeof(double);
+                    Push(Value::Floating);
+                    break;
+                case Op::Boolean:
+                    pc+=sizeof(uint8_t);
+                    Push(Value::Boolean);
+                    break;
+                case Op::String:
+                    pc+=sizeof(uint32_t);
+                    Push(Value::String);
+                    break;
+                case Op::Load:
+                    Push(types[Utils::GetObject<uint32_t>(code, pc)]);
+                    break;
+                case Op::Store:
+                    types[Utils::GetObject<uint32_t>(code, pc)] = Pop();
+                    break;
+                case Op::Declare:
+                case Op::DeclareInteger:
+                    {
+                        const uint32_t slot = Utils::GetObject<uint32_t>(code, pc);
+                        const uint8_t t = Pop();
+                        if(t==Value::Integer)
+                            Rewrite(at, Op::DeclareInteger);
+                        else
+                            Convert(t, Value::Integer, "");
+                        types[slot] = Value::Integer;
+                    }
+                    break;
+                case Op::Clear:
+                    {
+                        const uint32_t slot = Utils::GetObject<uint32_t>(code, pc);
+                        const uint32_t count = Utils::GetObject<uint32_t>(code, pc);
+                        for(uint32_t i = 0; i<count; i++)
+                            types[slot+i] = Value::Null;
+                    }
+                    break;
+                case Op::Detach:
+                    break;
+                case Op::Drop:
+                    Pop();
+                    break;
+                case Op::GetProperty:
+                    Property(context, Utils::GetObject<uint32_t>(code, pc));
+                    break;
+                case Op::SetProperty:
+                    SetProperty(context, Utils::GetObject<uint32_t>(code, pc));
+                    break;
+                case Op::GetModuleProperty:
+                    {
+                        const Context *const module = Module(Utils::GetObject<uint32_t>(code, pc));
+                        const uint32_t symbol = Utils::GetObject<uint32_t>(code, pc);
+                        if(module)
+                            Property(*module, symbol);
+                        else
+                            Push(Unknown);
+                    }
+                    break;
+                case Op::SetModuleProperty:
+                    {
+                        const Context *const module = Module(Utils::GetObject<uint32_t>(code, pc));
+                        const uint32_t symbol = Utils::GetObject<uint32_t>(code, pc);
+                        if(module)
+                            SetProperty(*module, symbol);
+                        else
+                            Pop();
+                    }
+                    break;
+                case Op::GetCached:
+                case Op::SetCached:
+                    {
+                        const struct Program::Cached &cached = program.cached[Utils::GetObject<uint32_t>(code, pc)];
+                        const Context *const module = cached.module ? Module(cached.module) : &context;
+                        if(op==Op::GetCached){
+                            if(module)
+                                Property(*module, cached.symbol);
+                            else
+                                Push(Unknown);
+                        }
+                        else{
+                            if(module)
+                                SetProperty(*module, cached.symbol);
+                            else
+                                Pop();
+                        }
+                    }
+                    break;
+                case Op::Index:
+                    {
+                        const uint8_t index = Pop();
+                        Indexed(Pop());
+                        Convert(index, Value::Integer, "");
+                        Push(Unknown);
+                    }
+                    break;
+                case Op::StoreElement:
+                    {
+                        const uint32_t slot = Utils::GetObject<uint32_t>(code, pc);
+                        Pop();
+                        const uint8_t index = Pop();
+                        Indexed(types[slot]);
+                        Convert(index, Value::Integer, "");
+                    }
+                    break;
+                case Op::Length:
+                    {
+                        const uint8_t t = Pop();
+                        if(t!=Unknown && t!=Value::Array)
+                            Fail("Only arrays have a length");
+                        Push(Value::Integer);
+                    }
+                    break;
+                case Op::NewArray:
+                    pc+=sizeof(uint8_t);
+                    Convert(Pop(), Value::Integer, "");
+                    Push(Value::Array);
+                    break;
+                case Op::Intrinsic:
+                    CallIntrinsic(static_cast<Intrinsic::Code>(Utils::GetObject<uint8_t>(code, pc)));
+                    break;
+                case Op::Add:
+                case Op::Subtract:
+                case Op::Multiply:
+                case Op::Divide:
+                case Op::Remainder:
+                    Arithmetic(at, op);
+                    break;
+                case Op::AddInteger:
+                case Op::SubtractInteger:
+                case Op::MultiplyInteger:
+                case Op::DivideInteger:
+                case Op::RemainderInteger:
+                case Op::AddFloating:
+                case Op::SubtractFloating:
+                case Op::MultiplyFloating:
+                case Op::DivideFloating:
+                case Op::RemainderFloating:
+                    Pop();
+                    break;
+                case Op::Equal:
+                case Op::NotEqual:
+                case Op::Less:
+                case Op::LessEqual:
+                case Op::Greater:
+                case Op::GreaterEqual:
+                    Comparison(at, op);
+                    break;
+                case Op::EqualInteger:
+                case Op::NotEqualInteger:
+                case Op::LessInteger:
+                case Op::LessEqualInteger:
+                case Op::GreaterInteger:
+                case Op::GreaterEqualInteger:
+                    Pop();
+                    Pop();
+                    Push(Value::Boolean);
+                    break;
+                case Op::Not:
+                    Convert(Pop(), Value::Boolean, "");
+                    Push(Value::Boolean);
+                    break;
+                case Op::Jump:
+                    Merge(Find(Utils::GetObject<uint32_t>(code, pc)));
+                    return;
+                case Op::JumpIfFalse:
+                case Op::JumpIfTrue:
+                case Op::Wait:
+                    {
+                        /* Wait goes back to its condition when resumed */
+                        const uint32_t to = Utils::GetObject<uint32_t>(code, pc);
+                        Convert(Pop(), Value::Boolean, "");
+                        Merge(Find(to));
+                    }
+                    break;
+                case Op::Call:
+                    depth-=program.token_procedure_table[Utils::GetObject<uint32_t>(code, pc)].arguments;
+                    Push(Unknown);
+                    break;
+                case Op::CallNamed:
+                    {
+                        const uint32_t symbol = Utils::GetObject<uint32_t>(code, pc);
+                        Call(context, symbol, Utils::GetObject<uint32_t>(code, pc), true);
+                    }
+                    break;
+                case Op::CallModule:
+                    {
+                        const Context *const module = Module(Utils::GetObject<uint32_t>(code, pc));
+                        const uint32_t symbol = Utils::GetObject<uint32_t>(code, pc);
+                        const uint32_t arguments = Utils::GetObject<uint32_t>(code, pc);
+                        if(module){
+                            Call(*module, symbol, arguments, false);
+                        }
+                        else{
+                            depth-=arguments;
+                            Push(Unknown);
+                        }
+                    }
+                    break;
+                case Op::Return:
+                case Op::End:
+                    return;
+                case Op::Release:
+                case Op::Yield:
+                    break;
+            }
+
+            if(pc==next){
+                Merge(index+1);
+                return;
+            }
+        }
+    }
+
+    void Run(){
+        /* Blocks start at the top, at each procedure, and where jumps go */
+        const size_t procedures = program.token_procedure_table.size();
+        count = 1+procedures+program.targets.size();
+        starts = Allocate<uint32_t>(count);
+        starts[0] = 0;
+        for(size_t i = 0; i<procedures; i++)
+            starts[1+i] = program.token_procedure_table[i].entry;
+        std::copy(program.targets.begin(), program.targets.end(), starts+1+procedures);
+        std::sort(starts, starts+count);
+        count = std::unique(starts, starts+count)-starts;
+
+        blocks = Allocate<struct Block>(count);
+        memset(blocks, 0, sizeof(struct Block)*count);
+        queue = Allocate<uint32_t>(count);
+
+        uint32_t frame = program.slots+program.stack;
+        for(size_t i = 0; i<program.token_procedure_table.size(); i++)
+            frame = std::max(frame, program.token_procedure_table[i].slots+program.token_procedure_table[i].stack);
+        types = Allocate<uint8_t>(frame);
+
+        Enter(0, program.slots, program.stack, 0);
+        for(size_t i = 0; i<program.token_procedure_table.size(); i++){
+            const struct Procedure &p = program.token_procedure_table[i];
+            if(!p.Deferred())
+                Enter(p.entry, p.slots, p.stack, p.arguments);
+        }
+
+        /* Without loops, every path into a block comes before it, so its
+            types are already final when it is reached in order */
+        while(program.backwards && queued){
+            const uint32_t index = queue[--queued];
+            blocks[index].queued = false;
+            Walk(index);
+        }
+
+        /* Check the blocks in order, so the first error is reported */
+        final = true;
+        for(uint32_t i = 0; i<count && err.succeeded; i++){
+            if(blocks[i].reached)
+                Walk(i);
+        }
+    }
+
+};
+
+struct Error Verify(struct Program &program, const Context &context, Arena &arena, const SymbolTable &symbols){
+    const Arena::Mark mark = arena.GetMark();
+
+    Verifier verifier(program, context, arena, symbols);
+    verifier.Run();
+
+    arena.Release(mark);
+    return verifier.err;
+}
+
+} // namespace Lithium
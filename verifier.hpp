@@ -0,0 +1,18 @@
+#pragma once
+#include "lithium.hpp"
+#include "program.hpp"
+#include "arena.hpp"
+
+namespace Lithium{
+
+/* Checks a compiled Program against the Context it is to run in, before it
+    runs. Every property, module, and procedure it names must exist, and
+    operands whose types are known must suit their instructions. Arithmetic on
+    operands proven to be integers or floating point is rewritten to the typed
+    instructions, which the VM runs without checking. Any scratch memory is
+    taken from `arena' and released before returning. Names in errors are
+    from `symbols'. */
+struct Error Verify(struct Program &program, const Context &context, Arena &arena,
+    const SymbolTable &symbols = Symbols());
+
+}